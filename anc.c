@@ -0,0 +1,201 @@
+#include "anc.h"
+
+// Apply the pending delta of n to its children.
+static inline void anc_push(struct anc_node *n)
+{
+    if (!n->add)
+        return;
+    if (n->l) {
+        n->l->pos += n->add;
+        n->l->add += n->add;
+    }
+    if (n->r) {
+        n->r->pos += n->add;
+        n->r->add += n->add;
+    }
+    n->add = 0;
+}
+
+static inline void anc_update(struct anc_node *n)
+{
+    if (n->l)
+        n->l->p = n;
+    if (n->r)
+        n->r->p = n;
+}
+
+static inline void anc_shift(struct anc_node *n, u64 d)
+{
+    if (!n)
+        return;
+    n->pos += d;
+    n->add += d;
+}
+
+static inline u32 anc_rand(struct anc *a)
+{
+    // xorshift32
+    u32 x = a->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    a->seed = x;
+    return x;
+}
+
+internal struct anc_node* anc_merge(struct anc_node *a, struct anc_node *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    
+    if (a->prio > b->prio) {
+        anc_push(a);
+        a->r = anc_merge(a->r, b);
+        anc_update(a);
+        return a;
+    } else {
+        anc_push(b);
+        b->l = anc_merge(a, b->l);
+        anc_update(b);
+        return b;
+    }
+}
+
+// Split n so that l holds the anchors before pos and r holds the rest.
+internal void anc_split(struct anc_node *n, u64 pos, struct anc_node **l, struct anc_node **r)
+{
+    if (!n) {
+        *l = *r = NULL;
+        return;
+    }
+    
+    anc_push(n);
+    if (n->pos < pos) {
+        anc_split(n->r, pos, &n->r, r);
+        anc_update(n);
+        *l = n;
+    } else {
+        anc_split(n->l, pos, l, &n->l);
+        anc_update(n);
+        *r = n;
+    }
+}
+
+internal void anc_insert(struct anc *a, struct anc_node *n, u64 pos)
+{
+    n->l = n->r = n->p = NULL;
+    n->pos = pos;
+    n->add = 0;
+    
+    struct anc_node *l,*r;
+    anc_split(a->root, pos, &l, &r);
+    a->root = anc_merge(anc_merge(l, n), r);
+    a->root->p = NULL;
+}
+
+internal void anc_unlink(struct anc *a, struct anc_node *n)
+{
+    // n's ancestors stay the same for whatever takes its place, so their pending
+    // deltas still apply to it
+    anc_push(n);
+    struct anc_node *m = anc_merge(n->l, n->r);
+    struct anc_node *p = n->p;
+    if (m)
+        m->p = p;
+    
+    if (!p)
+        a->root = m;
+    else if (p->l == n)
+        p->l = m;
+    else
+        p->r = m;
+}
+
+// Detach the anchors of n into left, at pos, and right, at pos + ins, following the
+// rules of anc_edit.
+internal void anc_collapse(struct anc_node *n, u64 pos, u64 del, u64 ins, struct anc_node **left, struct anc_node **right)
+{
+    if (!n)
+        return;
+    
+    anc_push(n);
+    anc_collapse(n->l, pos, del, ins, left, right);
+    anc_collapse(n->r, pos, del, ins, left, right);
+    
+    bool end;
+    if (del && n->pos == pos)
+        end = false;
+    else if (del && n->pos == pos + del)
+        end = true;
+    else
+        end = n->bias == ANC_RIGHT;
+    
+    n->l = n->r = NULL;
+    n->pos = end ? pos + ins : pos;
+    if (end)
+        *right = anc_merge(*right, n);
+    else
+        *left = anc_merge(*left, n);
+}
+
+def_create_anc(create_anc)
+{
+    memset(a, 0, sizeof(*a));
+    a->alloc = alloc;
+    a->seed = 0x2545f491;
+}
+
+def_anc_add(anc_add)
+{
+    if (!a->free) {
+        struct anc_node *slab = allocate(a->alloc, sizeof(*slab) * ANC_SLAB_CNT);
+        if (!slab) {
+            log_error("Failed to allocate anchor node slab");
+            return NULL;
+        }
+        for(u32 i=0; i < ANC_SLAB_CNT - 1; ++i)
+            slab[i].l = &slab[i+1];
+        slab[ANC_SLAB_CNT - 1].l = NULL;
+        a->free = slab;
+    }
+    
+    struct anc_node *n = a->free;
+    a->free = n->l;
+    n->prio = anc_rand(a);
+    n->bias = bias;
+    anc_insert(a, n, pos);
+    a->cnt += 1;
+    return n;
+}
+
+def_anc_remove(anc_remove)
+{
+    anc_unlink(a, n);
+    n->l = a->free;
+    a->free = n;
+    a->cnt -= 1;
+}
+
+def_anc_move(anc_move)
+{
+    anc_unlink(a, n);
+    anc_insert(a, n, pos);
+}
+
+def_anc_edit(anc_edit)
+{
+    if (!del && !ins)
+        return;
+    
+    struct anc_node *l,*m,*r;
+    anc_split(a->root, pos, &l, &m);
+    anc_split(m, pos + del + 1, &m, &r);
+    anc_shift(r, ins - del);
+    
+    struct anc_node *ml = NULL, *mr = NULL;
+    anc_collapse(m, pos, del, ins, &ml, &mr);
+    
+    a->root = anc_merge(anc_merge(anc_merge(l, ml), mr), r);
+    if (a->root)
+        a->root->p = NULL;
+}
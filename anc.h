@@ -0,0 +1,69 @@
+#ifndef ANC_H
+#define ANC_H
+
+#include "../solh/sol.h"
+
+// Anchors are document positions that follow the text they sit next to as it is
+// edited, for the cursor, selection ends, marks and search hits. They live in a treap
+// ordered by position, where a node's children are shifted together by a pending
+// delta instead of one at a time. An edit shifts everything after it with a single
+// delta and only visits the anchors inside the edited range, so it costs
+// O(log anchors + anchors in the range).
+
+#define ANC_SLAB_CNT 1024 /* nodes allocated per node slab */
+
+// Where an anchor goes when text is inserted exactly at it, or when the range around
+// it is replaced.
+enum anc_bias {
+    ANC_LEFT, // stays before the new text
+    ANC_RIGHT, // moves past the new text
+};
+
+struct anc_node {
+    struct anc_node *l,*r,*p;
+    u64 pos; // position, before adding the pending deltas of the ancestors
+    u64 add; // delta still to be added to both subtrees, wraps for negative shifts
+    u32 prio; // treap heap priority
+    u32 bias;
+};
+
+struct anc {
+    struct anc_node *root;
+    struct anc_node *free; // node free list, linked through l
+    allocator_t *alloc;
+    u32 seed; // priority rng state
+    u32 cnt; // anchors in the tree
+};
+
+// Position of an anchor, O(depth).
+static inline u64 anc_pos(struct anc_node *n)
+{
+    u64 pos = n->pos;
+    for(struct anc_node *q = n->p; q; q = q->p)
+        pos += q->add;
+    return pos;
+}
+
+#ifdef LIB
+#define def_create_anc(name) void name(allocator_t *alloc, struct anc *a)
+def_create_anc(create_anc);
+
+// Returns NULL if no node could be allocated.
+#define def_anc_add(name) struct anc_node* name(struct anc *a, u64 pos, enum anc_bias bias)
+def_anc_add(anc_add);
+
+#define def_anc_remove(name) void name(struct anc *a, struct anc_node *n)
+def_anc_remove(anc_remove);
+
+#define def_anc_move(name) void name(struct anc *a, struct anc_node *n, u64 pos)
+def_anc_move(anc_move);
+
+// Map every anchor through the replacement of [pos,pos+del) with ins bytes. Anchors
+// before the range stay, anchors after it shift by ins - del, and anchors inside it
+// collapse to either end of the new text: the start of the range goes to the start,
+// the end of the range to the end, and anything else by its bias.
+#define def_anc_edit(name) void name(struct anc *a, u64 pos, u64 del, u64 ins)
+def_anc_edit(anc_edit);
+#endif // LIB
+
+#endif // ANC_H
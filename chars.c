@@ -1,6 +1,7 @@
 #include "chars.h"
+#include <emmintrin.h>
 
-char cht[CHT_SZ] = {
+u32 cht[CHT_SZ] = {
     [CH_a] = 'a',
     [CH_b] = 'b',
     [CH_c] = 'c',
@@ -100,4 +101,98 @@ char cht[CHT_SZ] = {
     [CH_LARR] = '<',
     [CH_RARR] = '>',
     [CH_QUES] = '?',
-};
\ No newline at end of file
+    
+    [CH_LAT1] =
+    0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8,
+    0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf, 0xb0,
+    0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8,
+    0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf, 0xc0,
+    0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+    0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf, 0xd0,
+    0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+    0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf, 0xe0,
+    0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+    0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef, 0xf0,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+    
+    [CH_NDASH] = 0x2013,
+    [CH_MDASH] = 0x2014,
+    [CH_LSQUO] = 0x2018,
+    [CH_RSQUO] = 0x2019,
+    [CH_LDQUO] = 0x201c,
+    [CH_RDQUO] = 0x201d,
+    [CH_BULL] = 0x2022,
+    [CH_HELLIP] = 0x2026,
+    [CH_EURO] = 0x20ac,
+    [CH_LARROW] = 0x2190,
+    [CH_RARROW] = 0x2192,
+    
+    [CH_REPL] = CH_CP_REPL,
+};
+
+def_cp_to_glyph(cp_to_glyph)
+{
+    if (cp >= '!' && cp <= '~')
+        return char_to_glyph((char)cp);
+    if (cp >= 0xa1 && cp <= 0xff)
+        return (u8)(CH_LAT1 + cp - 0xa1);
+    for(u32 i = CH_NDASH; i < CH_REPL; ++i) {
+        if (cht[i] == cp)
+            return (u8)i;
+    }
+    return CH_REPL;
+}
+
+def_utf8_decode(utf8_decode)
+{
+    static const u32 min[] = {0, 0, 0x80, 0x800, 0x10000}; // smallest codepoint per length
+    
+    u8 c = p[0];
+    u32 n,v;
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if (c >= 0xc2 && c < 0xe0) {
+        n = 2;
+        v = c & 0x1f;
+    } else if (c >= 0xe0 && c < 0xf0) {
+        n = 3;
+        v = c & 0x0f;
+    } else if (c >= 0xf0 && c < 0xf5) {
+        n = 4;
+        v = c & 0x07;
+    } else {
+        goto invalid;
+    }
+    
+    if (len < n)
+        goto invalid;
+    for(u32 i=1; i < n; ++i) {
+        if (!utf8_is_cont(p[i]))
+            goto invalid;
+        v = (v << 6) | (p[i] & 0x3f);
+    }
+    if (v < min[n] || (v >= 0xd800 && v < 0xe000) || v > 0x10ffff)
+        goto invalid;
+    
+    *cp = v;
+    return n;
+    
+    invalid: // goto label
+    *cp = CH_CP_REPL;
+    return 1;
+}
+
+def_ascii_run(ascii_run)
+{
+    u64 i = 0;
+    for(; len - i >= 16; i += 16) {
+        u32 m = (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i)));
+        if (m)
+            return i + (u64)ctz(m);
+    }
+    while(i < len && p[i] < 0x80)
+        i += 1;
+    return i;
+}
\ No newline at end of file
@@ -4,8 +4,11 @@
 #include "shader.h"
 
 #define CHT_SZ SH_SI_CNT
-extern char cht[CHT_SZ]; // char table in char.c
+extern u32 cht[CHT_SZ]; // codepoint of each glyph, table in char.c
 
+#define CH_CP_REPL 0xfffd /* replacement character */
+
+// Glyph of a printable ASCII char.
 static inline u8 char_to_glyph(char c)
 {
     return c - '!';
@@ -111,6 +114,44 @@ enum chars_enum {
     CH_LARR = '<' - '!',
     CH_RARR = '>' - '!',
     CH_QUES = '?' - '!',
+    
+    // Latin-1 supplement, U+00A1 to U+00FF in order
+    CH_LAT1 = '~' - '!' + 1,
+    
+    // punctuation and symbols common in comments and prose
+    CH_NDASH = CH_LAT1 + 0xff - 0xa1 + 1,
+    CH_MDASH,
+    CH_LSQUO,
+    CH_RSQUO,
+    CH_LDQUO,
+    CH_RDQUO,
+    CH_BULL,
+    CH_HELLIP,
+    CH_EURO,
+    CH_LARROW,
+    CH_RARROW,
+    
+    CH_REPL, // U+FFFD, drawn for anything without a glyph
 };
 
+#ifdef LIB
+// Glyph of a codepoint, CH_REPL for codepoints the glyph table does not cover.
+#define def_cp_to_glyph(name) u8 name(u32 cp)
+def_cp_to_glyph(cp_to_glyph);
+
+// Decode the UTF-8 sequence at the start of p[0..len) into cp and return its length.
+// Invalid, overlong and truncated sequences decode to U+FFFD one byte at a time.
+#define def_utf8_decode(name) u32 name(const u8 *p, u64 len, u32 *cp)
+def_utf8_decode(utf8_decode);
+
+// Length of the run of ASCII bytes at the start of p[0..len), checked 16 bytes at a time.
+#define def_ascii_run(name) u64 name(const u8 *p, u64 len)
+def_ascii_run(ascii_run);
+#endif // LIB
+
+static inline bool utf8_is_cont(u8 c)
+{
+    return (c & 0xc0) == 0x80;
+}
+
 #endif //CHARS_H
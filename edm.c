@@ -1,55 +1,437 @@
 #include "edm.h"
 #include "gpu.h"
+#include <emmintrin.h>
 
 struct edm *edm;
 
 struct edf_line_stat {
-    u64 i;
-    u16 ofs,row,col;
+    u64 i,line,ofs;
+    const u64 *csr,*csr_end; // positions of the cursors not yet passed
+    const u32 *brk,*brk_end; // visual line breaks of the line not yet passed, when wrapping
+    u64 start; // start of the line the breaks are relative to
+    u64 vofs; // column of the line at col 0 of the row
+    u16 row,col;
 };
 
-struct fgbg {
-    struct rgba fg;
-    struct rgba bg;
-};
+static inline bool edf_will_wrap_h(struct editor_file *edf, u32 lc)
+{
+    return edf->view.ext.h < edf->view.ofs.y + gpu->cell.dim_px.h * lc;
+}
 
-static inline struct fgbg edm_make_fgbg(struct rgba fg, struct rgba bg) {
-    return (struct fgbg) {.fg = fg, .bg = bg};
+// Index of the last cell that fits in the view.
+static inline u16 edf_last_col(struct editor_file *edf)
+{
+    if (edf->view.ext.w < edf->view.ofs.x)
+        return 0;
+    return (u16)((edf->view.ext.w - edf->view.ofs.x) / gpu->cell.dim_px.w);
 }
 
-static inline bool edf_will_wrap_w(struct editor_file *edf, u32 cc)
+static inline u16 edf_last_row(struct editor_file *edf)
 {
-    return edf->view.ext.w < edf->view.ofs.x + gpu->cell.dim_px.w * cc;
+    if (edf->view.ext.h < edf->view.ofs.y)
+        return 0;
+    return (u16)((edf->view.ext.h - edf->view.ofs.y) / gpu->cell.dim_px.h);
 }
 
-static inline bool edf_will_wrap_h(struct editor_file *edf, u32 lc)
+// Chars of the word at els.i, up to max.
+static inline u32 edf_word_len(struct editor_file *edf, struct txb_iter *it, struct edf_line_stat els, u32 max)
 {
-    return edf->view.ext.h < edf->view.ofs.y + gpu->cell.dim_px.h * lc;
+    u64 sz = txb_size(&edf->fb);
+    u32 n = 0;
+    for(u64 i = els.i; i < sz && n < max; ++i) {
+        u8 c = txb_byte(it, i);
+        if (c == ' ' || c == '\t' || c == '\n')
+            break;
+        n += !utf8_is_cont(c);
+    }
+    return n;
 }
 
-static inline int edf_next_line(struct editor_file *edf, struct edf_line_stat *els)
+// Glyph of the char at i and its length in bytes. ascii_end is how far the bytes
+// are already known to be ASCII, which is found a whole span at a time so that only
+// the chars outside such runs are decoded.
+static inline u8 edf_glyph(struct txb_iter *it, u64 size, u64 *ascii_end, u64 i, u32 *len)
 {
-    u32 inc = strfindchar(create_string(edf->fb.data + els->i, edf->fb.size - els->i), '\n');
-    if (inc == Max_u32)
-        return -1;
-    els->i += inc;
-    return 0;
+    u8 c = txb_byte(it, i);
+    if (i >= *ascii_end) {
+        u64 o = i - it->base;
+        *ascii_end = i + ascii_run(it->s + o, (u64)(it->e - it->s) - o);
+    }
+    *len = 1;
+    if (i < *ascii_end)
+        return char_to_glyph((char)c);
+    
+    // sequences can cross pieces
+    u8 q[4];
+    u64 n = size - i < sizeof(q) ? size - i : sizeof(q);
+    for(u32 j=0; j < n; ++j)
+        q[j] = txb_byte(it, i + j);
+    
+    u32 cp;
+    *len = utf8_decode(q, n, &cp);
+    return cp_to_glyph(cp);
 }
 
-static inline u32 edf_word_len(struct editor_file *edf, struct edf_line_stat els)
+// Columns from column c of a line to the next tab stop.
+static inline u32 edf_tab_cols(struct editor_file *edf, u64 c)
 {
-    charset_t wsnl = create_charset();
-    charset_add(&wsnl, ' ');
-    charset_add(&wsnl, '\n');
-    u32 l = strfindcharset(create_string(edf->fb.data + els.i, edf->fb.size - els.i), wsnl);
-    return l == Max_u32 ? (u32)(edf->fb.size - els.i) : l;
+    return edf->tab_w - (u32)(c % edf->tab_w);
 }
 
-internal void edf_newline(struct edf_line_stat *els)
+// Columns of the char at i, which is at column c of its line, and its length in bytes.
+static inline u32 edf_char_cols(struct editor_file *edf, struct txb_iter *it, u64 size, u64 *ascii_end, u64 i, u64 c, u32 *len)
 {
-    els->i += 1 + els->ofs;
-    els->row += 1;
+    if (txb_byte(it, i) == '\t') {
+        *len = 1;
+        return edf_tab_cols(edf, c);
+    }
+    edf_glyph(it, size, ascii_end, i, len);
+    return 1;
+}
+
+// Entry of line in the wrap cache, moving the window over it when it is outside.
+internal struct edf_wrap_line* edf_wrap_at(struct edf_wrap *w, u64 line)
+{
+    if (line - w->first >= EDM_WRAP_LINES) {
+        // keep what the old window shares with one that has line a quarter of the way in
+        u64 first = line > EDM_WRAP_LINES / 4 ? line - EDM_WRAP_LINES / 4 : 0;
+        struct edf_wrap_line old[EDM_WRAP_LINES];
+        memcpy(old, w->line, sizeof(old));
+        for(u64 j=0; j < EDM_WRAP_LINES; ++j) {
+            u64 k = first + j - w->first;
+            w->line[j] = k < EDM_WRAP_LINES ? old[k] : (struct edf_wrap_line) {};
+        }
+        w->first = first;
+    }
+    return &w->line[line - w->first];
+}
+
+// Keep the part of the map in old that comes before byte p, as an edit at p leaves the
+// columns before it as they were, and give it to l.
+internal void edf_map_cut(struct editor_file *edf, struct edf_wrap_line *l, struct edf_wrap_line *old, u64 p)
+{
+    if (old->tab_w != edf->tab_w)
+        return;
+    l->tab_w = old->tab_w;
+    l->step = old->step;
+    l->map = old->map;
+    l->map_cnt = old->map_cnt;
+    l->end_b = old->end_b;
+    l->end_c = old->end_c;
+    if (l->end_b <= p)
+        return;
+    
+    struct edf_col *m = edf->wrap.map + l->map;
+    u32 lo = 0, hi = l->map_cnt;
+    while(lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (m[mid].b <= p)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    l->map_cnt = lo;
+    l->end_b = lo ? m[lo-1].b : 0;
+    l->end_c = lo ? m[lo-1].c : 0;
+}
+
+// Renumber the wrap cache after an edit at byte p0 of line l0 that replaced lines [l0,l1]
+// with l1 - l0 + 1 + d new ones. Line l0 keeps the part of its column map before p0.
+internal void edf_wrap_edit(struct editor_file *edf, u64 l0, u64 p0, u64 l1, s64 d)
+{
+    struct edf_wrap *w = &edf->wrap;
+    // walk away from where the lines move to so each one is read before it is overwritten
+    for(u64 n=0; n < EDM_WRAP_LINES; ++n) {
+        u64 j = d > 0 ? EDM_WRAP_LINES - 1 - n : n;
+        u64 line = w->first + j;
+        if (line < l0)
+            continue;
+        
+        u64 k = line - (u64)d - w->first; // index the line had before the edit
+        if (line == l0) {
+            struct edf_wrap_line old = w->line[j];
+            w->line[j] = (struct edf_wrap_line) {};
+            edf_map_cut(edf, &w->line[j], &old, p0);
+        } else if (line <= l1 + (u64)d || k >= EDM_WRAP_LINES)
+            w->line[j] = (struct edf_wrap_line) {};
+        else
+            w->line[j] = w->line[k];
+    }
+}
+
+// Find where the line starting at s breaks when wrapped at cols, following the same
+// rules as the draw did when it wrapped as it went: a word that would not fit moves to
+// the next visual line unless it starts one, a word longer than a visual line breaks
+// wherever it reaches the end, and so do runs of spaces and tabs. Tab stops are counted
+// from the start of the logical line.
+internal void edf_wrap_line(struct editor_file *edf, u64 s, u16 cols, struct edf_wrap_line *l)
+{
+    struct edf_wrap *w = &edf->wrap;
+    struct txb_iter it = {.t = &edf->fb};
+    u64 size = txb_size(&edf->fb);
+    
+    wrap_start: // goto label
+    
+    l->w = cols;
+    l->cnt = 0;
+    l->brk = w->brk_used;
+    
+    struct edf_line_stat els = {.i = s};
+    u64 ascii_end = 0;
+    u32 col = 0;
+    u64 vcol = 0;
+    bool word = true; // at the start of a word
+    while(els.i < size && l->cnt < EDM_WRAP_ROWS) {
+        u8 c = txb_byte(&it, els.i);
+        if (c == '\n')
+            break;
+        
+        u32 len = 1;
+        u32 cw = 1; // columns
+        bool brk;
+        if (c == ' ' || c == '\t') {
+            brk = col >= cols;
+            word = true;
+            if (c == '\t')
+                cw = edf_tab_cols(edf, vcol);
+        } else {
+            brk = col >= cols || (word && col > 0 && col + edf_word_len(edf, &it, els, cols) >= cols);
+            edf_glyph(&it, size, &ascii_end, els.i, &len);
+            word = false;
+        }
+        
+        if (brk) {
+            if (w->brk_used == EDM_WRAP_BRKS) {
+                // out of room, start over with only the lines drawn from now on
+                for(u32 j=0; j < EDM_WRAP_LINES; ++j)
+                    w->line[j].w = 0;
+                w->brk_used = 0;
+                goto wrap_start;
+            }
+            w->brk[w->brk_used++] = (u32)(els.i - s);
+            l->cnt += 1;
+            col = 0;
+        }
+        col += cw;
+        vcol += cw;
+        els.i += len;
+    }
+}
+
+// Length of the run at the start of p[0..n) that is a column a byte: ASCII other than tabs.
+static inline u64 edf_plain_run(const u8 *p, u64 n)
+{
+    u64 k = 0;
+    for(; k + 16 <= n; k += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + k));
+        u32 m = (u32)_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        if (m)
+            return k + ctz(m);
+    }
+    while(k < n && p[k] != '\t' && p[k] < 0x80)
+        k += 1;
+    return k;
+}
+
+// Count the chars of the line [s,e) from byte *b, at column *c, up to byte to_b or the
+// char that covers column to_c, whichever comes first. A char that to_b is inside of
+// is not passed either.
+internal void edf_col_walk(struct editor_file *edf, u64 s, u64 e, u64 *b, u64 *c, u64 to_b, u64 to_c)
+{
+    struct txb_iter it = {.t = &edf->fb};
+    u64 size = txb_size(&edf->fb);
+    u64 ascii_end = 0;
+    while(s + *b < e && *b < to_b) {
+        txb_byte(&it, s + *b); // seek to the span holding b
+        const u8 *p = it.s + (s + *b - it.base);
+        u64 n = (u64)(it.e - p);
+        if (n > e - s - *b)
+            n = e - s - *b;
+        if (n > to_b - *b)
+            n = to_b - *b;
+        if (n > to_c - *c)
+            n = to_c - *c;
+        
+        u64 k = edf_plain_run(p, n);
+        *b += k;
+        *c += k;
+        if (k == n) {
+            if (*c == to_c)
+                break;
+            continue;
+        }
+        
+        u32 len;
+        u32 cols = edf_char_cols(edf, &it, size, &ascii_end, s + *b, *c, &len);
+        if (*c + cols > to_c || *b + len > to_b)
+            break;
+        *b += len;
+        *c += cols;
+    }
+}
+
+// Start the map of l over, with nothing counted yet.
+static inline void edf_map_reset(struct editor_file *edf, struct edf_wrap_line *l)
+{
+    l->tab_w = edf->tab_w;
+    l->step = EDM_MAP_STEP;
+    l->map_cnt = 0;
+    l->end_b = 0;
+    l->end_c = 0;
+}
+
+// Add a checkpoint to the end of the map of l, which has to be the last in the pool to
+// grow. A line with too many checkpoints keeps every other one, and twice the step.
+internal void edf_map_push(struct editor_file *edf, struct edf_wrap_line *l, u64 b, u64 c)
+{
+    struct edf_wrap *w = &edf->wrap;
+    if (l->map_cnt == EDM_MAP_LINE_CKPTS) {
+        for(u32 i=0; i < l->map_cnt / 2; ++i)
+            w->map[l->map + i] = w->map[l->map + i * 2 + 1];
+        l->map_cnt /= 2;
+        l->step *= 2;
+    }
+    
+    if (l->map + l->map_cnt != w->map_used || w->map_used == EDM_MAP_CKPTS) {
+        if (w->map_used + l->map_cnt >= EDM_MAP_CKPTS) {
+            // out of room, start over with this line and the lines looked up from now on
+            for(u32 j=0; j < EDM_WRAP_LINES; ++j) {
+                if (&w->line[j] != l)
+                    w->line[j].tab_w = 0;
+            }
+            memmove(w->map, w->map + l->map, sizeof(*w->map) * l->map_cnt);
+            w->map_used = 0;
+        } else if (l->map_cnt) {
+            memcpy(w->map + w->map_used, w->map + l->map, sizeof(*w->map) * l->map_cnt);
+        }
+        l->map = w->map_used;
+        w->map_used += l->map_cnt;
+    }
+    
+    w->map[w->map_used++] = (struct edf_col) {.b = b, .c = c};
+    l->map_cnt += 1;
+}
+
+// Count more of the line [s,e) into the map of l, until it passes byte to_b or column
+// to_c, with a checkpoint at the first char boundary past each multiple of the step.
+internal void edf_map_extend(struct editor_file *edf, struct edf_wrap_line *l, u64 s, u64 e, u64 to_b, u64 to_c)
+{
+    struct txb_iter it = {.t = &edf->fb};
+    u64 size = txb_size(&edf->fb);
+    u64 ascii_end = 0;
+    while(s + l->end_b < e && l->end_b < to_b && l->end_c <= to_c) {
+        u64 next = (l->end_c / l->step + 1) * l->step;
+        u64 b = l->end_b;
+        u64 c = l->end_c;
+        edf_col_walk(edf, s, e, &b, &c, Max_u64, next);
+        if (c < next && s + b < e) {
+            // a tab across the step, the checkpoint goes after it
+            u32 len;
+            c += edf_char_cols(edf, &it, size, &ascii_end, s + b, c, &len);
+            b += len;
+        }
+        l->end_b = b;
+        l->end_c = c;
+        if (s + b < e)
+            edf_map_push(edf, l, b, c);
+    }
+}
+
+// Entry of line in the wrap cache, with a column map for the current tab width.
+internal struct edf_wrap_line* edf_line_map(struct editor_file *edf, u64 line)
+{
+    struct edf_wrap_line *l = edf_wrap_at(&edf->wrap, line);
+    if (l->tab_w != edf->tab_w)
+        edf_map_reset(edf, l);
+    return l;
+}
+
+// Column of byte b of line. A byte inside a char gives the column the char starts at.
+// The map is counted as far as b if it does not reach it yet, and after that it is a
+// binary search for the checkpoint before b and at most a step of chars.
+internal u64 edf_byte_col(struct editor_file *edf, u64 line, u64 b)
+{
+    u64 s = txb_line_start(&edf->fb, line);
+    u64 e = txb_line_end(&edf->fb, line);
+    struct edf_wrap_line *l = edf_line_map(edf, line);
+    edf_map_extend(edf, l, s, e, b, Max_u64);
+    
+    // checkpoints at or before b
+    struct edf_col *m = edf->wrap.map + l->map;
+    u32 lo = 0, hi = l->map_cnt;
+    while(lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (m[mid].b <= b)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    u64 x = lo ? m[lo-1].b : 0;
+    u64 c = lo ? m[lo-1].c : 0;
+    edf_col_walk(edf, s, e, &x, &c, b, Max_u64);
+    return c;
+}
+
+// Byte of line at column c: the start of the char that covers c, or the end of the line
+// if it is shorter. at is the column the char starts at, which is short of c for a tab.
+internal u64 edf_col_byte(struct editor_file *edf, u64 line, u64 c, u64 *at)
+{
+    u64 s = txb_line_start(&edf->fb, line);
+    u64 e = txb_line_end(&edf->fb, line);
+    struct edf_wrap_line *l = edf_line_map(edf, line);
+    edf_map_extend(edf, l, s, e, Max_u64, c);
+    
+    // checkpoints at or before c
+    struct edf_col *m = edf->wrap.map + l->map;
+    u32 lo = 0, hi = l->map_cnt;
+    while(lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (m[mid].c <= c)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    u64 b = lo ? m[lo-1].b : 0;
+    *at = lo ? m[lo-1].c : 0;
+    edf_col_walk(edf, s, e, &b, at, Max_u64, c);
+    return b;
+}
+
+// Move to the first visible char of line, which is at column ofs when scrolled
+// horizontally, and to the visual line breaks of the line when wrapping. A tab across
+// the left edge of the view is left out, and the chars after it start where it ends.
+internal void edf_line_begin(struct editor_file *edf, struct edf_line_stat *els, u64 line)
+{
+    u64 s = txb_line_start(&edf->fb, line);
+    u64 e = txb_line_end(&edf->fb, line);
+    els->line = line;
+    els->i = s;
     els->col = 0;
+    els->vofs = els->ofs;
+    if (els->ofs) {
+        u64 at;
+        els->i = s + edf_col_byte(edf, line, els->ofs, &at);
+        if (at < els->ofs && els->i < e) {
+            els->col = (u16)(at + edf_tab_cols(edf, at) - els->ofs);
+            els->i += 1;
+        }
+    }
+    
+    if (edf->flags & EDF_WRAP) {
+        u16 cols = (u16)(edf_last_col(edf) + 1);
+        struct edf_wrap_line *l = edf_wrap_at(&edf->wrap, line);
+        if (l->w != cols)
+            edf_wrap_line(edf, s, cols, l);
+        els->start = s;
+        els->brk = edf->wrap.brk + l->brk;
+        els->brk_end = els->brk + l->cnt;
+    }
+}
+
+internal void edf_newline(struct editor_file *edf, struct edf_line_stat *els)
+{
+    edf_line_begin(edf, els, els->line + 1);
+    els->row += 1;
 }
 
 internal void edf_newcol(struct edf_line_stat *els)
@@ -58,70 +440,1006 @@ internal void edf_newcol(struct edf_line_stat *els)
     els->col += 1;
 }
 
+// Move past the tab at els->i to the next tab stop.
+internal void edf_newtab(struct editor_file *edf, struct edf_line_stat *els)
+{
+    els->i += 1;
+    els->col += (u16)edf_tab_cols(edf, els->vofs + els->col);
+}
 
 internal void edf_virtual_newline(struct edf_line_stat *els)
 {
     els->row += 1;
+    els->vofs += els->col;
     els->col = 0;
 }
 
-#define EDM_ROW_PAD 0 /* padding between rows in pixels */
-#define EDM_CSR_PAD 1 /* increase cursor size in y*/
+static inline void edf_maybe_break(struct edf_line_stat *els)
+{
+    if (els->brk < els->brk_end && els->i >= els->start + *els->brk) {
+        els->brk += 1;
+        edf_virtual_newline(els);
+    }
+}
 
-static inline struct rect_u16 edm_make_char_rect(struct edf_line_stat els, struct offset_u16 view_ofs, char c) {
-    log_error_if(is_whitechar(c), "This function should not be called with whitespace.");
-    u32 i = char_to_glyph(c);
-    struct rect_u16 r = {};
-    r.ofs.x = (u16)(view_ofs.x + gpu->cell.dim_px.w * els.col + gpu->glyph[i].x);
-    r.ofs.y = (u16)(view_ofs.y + (gpu->cell.dim_px.h + EDM_ROW_PAD) * (els.row+1) + gpu->glyph[i].y);
-    r.ext.w = gpu->glyph[i].w;
-    r.ext.h = gpu->glyph[i].h;
-    return r;
+static inline void edf_draw_cursor(struct editor_file *edf, struct edf_line_stat els)
+{
+    gpu_db_add(els.col, els.row, GPU_GLYPH_BLOCK, GPU_PAL_CSR);
 }
 
-static inline struct rect_u16 edm_make_cursor_rect(struct edf_line_stat els, struct offset_u16 view_ofs) {
-    struct rect_u16 r = {};
-    r.ofs.x = (u16)(view_ofs.x + gpu->cell.dim_px.w * els.col);
-    r.ofs.y = (u16)(view_ofs.y + (gpu->cell.dim_px.h + EDM_ROW_PAD) * (els.row+1) + (s16)gpu->cell.y_ofs - EDM_CSR_PAD);
-    r.ext.w = gpu->cell.dim_px.w;
-    r.ext.h = gpu->cell.dim_px.h + EDM_CSR_PAD;
-    return r;
+// Whether a cursor is on the char at els->i. The draw only moves forward through the
+// document, so cursors before it are passed for good.
+static inline bool edf_at_cursor(struct edf_line_stat *els)
+{
+    while(els->csr < els->csr_end && *els->csr < els->i)
+        els->csr += 1;
+    return els->csr < els->csr_end && *els->csr == els->i;
+}
+
+static inline void edf_maybe_draw_cursor(struct editor_file *edf, struct edf_line_stat *els)
+{
+    if (!edf_at_cursor(els))
+        return;
+    edf_draw_cursor(edf, *els);
 }
 
-static inline struct fgbg edm_char_col(char c)
+// The grid always holds the plain glyph, and a cursor goes over it for this frame only,
+// so moving or blinking a cursor leaves the grid as it was.
+static inline void edf_draw_glyph(struct editor_file *edf, struct edf_line_stat *els, u8 g)
 {
-    log_error_if(is_whitechar(c), "This function should not be called with whitespace.");
-    struct fgbg r = edm_make_fgbg(FG_COL, BG_COL);
-    r.bg.a = char_to_glyph(c);
+    gpu_grid_set(els->col, els->row, g, GPU_PAL_TEXT);
+    if (edf_at_cursor(els)) {
+        edf_draw_cursor(edf, *els);
+        gpu_db_add(els->col, els->row, g, GPU_PAL_CSR);
+    }
+}
+
+// Glyphs of the run of printable ASCII at the start of p[0..n) into dst, with spaces as
+// empty cells, and return its length. Bytes are classified and turned into glyphs 16 at
+// a time.
+static inline u32 edf_glyph_run(u8 *dst, const u8 *p, u32 n)
+{
+    u32 i = 0;
+    while(i < n) {
+        u8 g[16];
+        u32 m = n - i < 16 ? n - i : 16;
+        u32 bad;
+        if (m == 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            // signed compare, so bytes past 0x7f count as below ' ' too
+            __m128i ctl = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+            __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+            bad = (u32)_mm_movemask_epi8(ctl);
+            _mm_storeu_si128((__m128i*)g, _mm_or_si128(_mm_sub_epi8(v, _mm_set1_epi8('!')), sp));
+        } else {
+            bad = 0;
+            for(u32 j=0; j < m; ++j) {
+                u8 c = p[i+j];
+                bad |= (u32)(c < ' ' || c >= 0x7f) << j;
+                g[j] = c == ' ' ? GPU_GLYPH_NONE : (u8)(c - '!');
+            }
+        }
+        
+        u32 run = bad ? (u32)ctz(bad) : m;
+        memcpy(dst + i, g, run);
+        
+        i += run;
+        if (run < 16)
+            break;
+    }
+    return i;
+}
+
+// Lay out the visible part of the line at els into g, a cell per column of the view that
+// starts out empty, and return the cells up to the end of its last char. Runs of printable
+// ASCII go 16 bytes at a time, and only the chars between them take the per char path.
+internal u32 edf_layout_row(struct editor_file *edf, struct edf_line_stat *els, struct txb_iter *it, u8 *g, u16 cols)
+{
+    u64 size = txb_size(&edf->fb);
+    u64 ascii_end = 0;
+    u64 e = txb_line_end(&edf->fb, els->line);
+    memset(g, GPU_GLYPH_NONE, cols);
+    
+    while(els->i < e && els->col < cols) {
+        txb_byte(it, els->i); // seek to the span holding i
+        const u8 *p = it->s + (els->i - it->base);
+        u64 n = e - els->i;
+        if (n > (u64)(it->e - p))
+            n = (u64)(it->e - p);
+        if (n > (u64)(cols - els->col))
+            n = cols - els->col;
+        
+        u32 k = edf_glyph_run(g + els->col, p, (u32)n);
+        els->i += k;
+        els->col += (u16)k;
+        if (k == n)
+            continue;
+        
+        // whitespace other than spaces is an empty cell, and a tab goes to the next stop
+        u8 c = txb_byte(it, els->i);
+        if (c == '\t') {
+            edf_newtab(edf, els);
+        } else if (is_whitechar(c)) {
+            edf_newcol(els);
+        } else {
+            u32 len;
+            g[els->col] = edf_glyph(it, size, &ascii_end, els->i, &len);
+            els->i += len;
+            els->col += 1;
+        }
+    }
+    return els->col < cols ? els->col : cols;
+}
+
+// Draw the cursors on the line at els over its row for this frame, with the glyph under
+// each one taken from the layout g. A cursor left of the view, or on a tab across its
+// left edge, is not drawn.
+internal void edf_draw_row_cursors(struct editor_file *edf, struct edf_line_stat *els, const u8 *g, u32 cnt, u16 cols)
+{
+    u64 s = txb_line_start(&edf->fb, els->line);
+    u64 e = txb_line_end(&edf->fb, els->line);
+    while(els->csr < els->csr_end && *els->csr < s)
+        els->csr += 1;
+    
+    // a cursor on the newline, or at the end of the file, is at e
+    for(; els->csr < els->csr_end && *els->csr <= e; els->csr += 1) {
+        u64 c = edf_byte_col(edf, els->line, *els->csr - s);
+        if (c < els->ofs || c - els->ofs >= cols)
+            continue;
+        
+        u16 x = (u16)(c - els->ofs);
+        gpu_db_add(x, els->row, GPU_GLYPH_BLOCK, GPU_PAL_CSR);
+        if (x < cnt && g[x] != GPU_GLYPH_NONE)
+            gpu_db_add(x, els->row, g[x], GPU_PAL_CSR);
+    }
+}
+
+// Draw rows lines a row per line, for when the view does not wrap. The layout of each
+// line is kept in the run cache, and a line that was laid out at the same scroll, width
+// and tab width since it was last edited is copied to the grid without reading its text,
+// so a frame costs about as much layout as the lines that changed. Cursors go over the
+// rows, and rows wrap around the grid.
+internal void edf_draw_rows(struct editor_file *edf, struct edf_line_stat *els, struct txb_iter *it, u32 rows)
+{
+    struct edf_wrap *w = &edf->wrap;
+    u16 cols = (u16)(edf_last_col(edf) + 1);
+    
+    for(u32 r=1;; ++r) {
+        struct edf_wrap_line *l = edf_wrap_at(w, els->line);
+        if (l->run_w != cols || l->run_ofs != els->ofs || l->run_tab_w != edf->tab_w) {
+            if (w->run_used + cols > EDM_RUN_CELLS) {
+                // out of room, start over with only the lines drawn from now on
+                for(u32 j=0; j < EDM_WRAP_LINES; ++j)
+                    w->line[j].run_w = 0;
+                w->run_used = 0;
+            }
+            l->run = w->run_used;
+            l->run_cnt = (u16)edf_layout_row(edf, els, it, w->run + l->run, cols);
+            l->run_w = cols;
+            l->run_tab_w = edf->tab_w;
+            l->run_ofs = els->ofs;
+            w->run_used += l->run_cnt;
+        }
+        
+        const u8 *g = w->run + l->run;
+        gpu_grid_set_span(0, els->row, g, l->run_cnt, GPU_PAL_TEXT);
+        edf_draw_row_cursors(edf, els, g, l->run_cnt, cols);
+        
+        if (r >= rows || els->line + 1 >= txb_line_cnt(&edf->fb))
+            break;
+        edf_newline(edf, els);
+        if (els->row == gpu->grid.rows)
+            els->row = 0;
+    }
+}
+
+// Keep the text where it was drawn when the first line changes, and ease it to its new
+// place over the next frames. Past the overscan there are no rows to show, so a longer
+// jump only eases the last of it.
+internal void edf_scroll_to(struct editor_file *edf, u64 first)
+{
+    s64 h = gpu->cell.dim_px.h + GPU_ROW_PAD;
+    s64 max = GPU_OVERSCAN * h;
+    s64 px = edf->scroll_px + ((s64)first - (s64)edf->top_line) * h;
+    edf->top_line = first;
+    edf->scroll_px = (s32)(px < -max ? -max : px > max ? max : px);
+    if (edf->scroll_px == 0)
+        return;
+    
+    s32 step = edf->scroll_px / EDM_SCROLL_EASE;
+    if (step == 0)
+        step = edf->scroll_px > 0 ? 1 : -1;
+    edf->scroll_px -= step;
+    prg_wake_at(win_ms() + EDM_SCROLL_STEP_MS);
+}
+
+// Grow the cursor array, and the scratch positions with it, to hold cnt cursors.
+internal int edf_reserve_cursors(struct editor_file *edf, u32 cnt)
+{
+    if (cnt <= edf->csr_cap)
+        return 0;
+    
+    u32 c = edf->csr_cap ? edf->csr_cap : EDM_CSR_CNT;
+    while(c < cnt)
+        c *= 2;
+    struct anc_node **csr = allocate(&edm->alloc, sizeof(*csr) * c);
+    u64 *pos = allocate(&edm->alloc, sizeof(*pos) * c);
+    if (!csr || !pos) {
+        log_error("Failed to grow cursor array to %u cursors", c);
+        return -1;
+    }
+    if (edf->csr_cnt)
+        memcpy(csr, edf->csr, sizeof(*csr) * edf->csr_cnt);
+    edf->csr = csr;
+    edf->csr_pos = pos;
+    edf->csr_cap = c;
+    return 0;
+}
+
+// Fill csr_pos with the position of every cursor.
+internal u64* edf_cursor_pos(struct editor_file *edf)
+{
+    for(u32 i=0; i < edf->csr_cnt; ++i)
+        edf->csr_pos[i] = anc_pos(edf->csr[i]);
+    return edf->csr_pos;
+}
+
+internal int edf_add_cursor(struct editor_file *edf, u64 pos)
+{
+    if (edf_reserve_cursors(edf, edf->csr_cnt + 1))
+        return -1;
+    
+    u32 lo = 0;
+    u32 hi = edf->csr_cnt;
+    while(lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (anc_pos(edf->csr[mid]) < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < edf->csr_cnt && anc_pos(edf->csr[lo]) == pos)
+        return 0;
+    
+    struct anc_node *n = anc_add(&edf->anc, pos, ANC_RIGHT);
+    if (!n)
+        return -1;
+    memmove(edf->csr + lo + 1, edf->csr + lo, sizeof(*edf->csr) * (edf->csr_cnt - lo));
+    edf->csr[lo] = n;
+    edf->csr_cnt += 1;
+    return 0;
+}
+
+// Drop cursors that ended up on the same char as the one before them. Edits and
+// cursor movement never reorder cursors, so the array stays sorted.
+internal void edf_merge_cursors(struct editor_file *edf)
+{
+    u32 k = 0;
+    u64 prev = 0;
+    for(u32 i=0; i < edf->csr_cnt; ++i) {
+        struct anc_node *n = edf->csr[i];
+        u64 pos = anc_pos(n);
+        if (k && pos == prev) {
+            if (n == edf->cursor) {
+                anc_remove(&edf->anc, edf->csr[k-1]);
+                edf->csr[k-1] = n;
+            } else {
+                anc_remove(&edf->anc, n);
+            }
+            continue;
+        }
+        edf->csr[k++] = n;
+        prev = pos;
+    }
+    edf->csr_cnt = k;
+}
+
+internal void edf_single_cursor(struct editor_file *edf)
+{
+    for(u32 i=0; i < edf->csr_cnt; ++i) {
+        if (edf->csr[i] != edf->cursor)
+            anc_remove(&edf->anc, edf->csr[i]);
+    }
+    edf->csr[0] = edf->cursor;
+    edf->csr_cnt = 1;
+}
+
+internal struct editor_file* edm_create_file(struct string uri, struct string data)
+{
+    if (edm->file_cnt == EDM_MAX_FILES) {
+        log_error("Too many open files (max %u)", EDM_MAX_FILES);
+        return NULL;
+    }
+    
+    struct editor_file *edf = &edm->edf[edm->file_cnt];
+    memset(edf, 0, sizeof(*edf));
+    
+    if (create_txb(data, &edm->alloc, &edf->fb)) {
+        log_error("Failed to create text buffer for file %s", uri.data);
+        return NULL;
+    }
+    edf->hist.e = allocate(&edm->alloc, sizeof(*edf->hist.e) * EDM_UNDO_CNT);
+    if (!edf->hist.e) {
+        log_error("Failed to allocate undo history for file %s", uri.data);
+        return NULL;
+    }
+    edf->wrap.line = allocate(&edm->alloc, sizeof(*edf->wrap.line) * EDM_WRAP_LINES);
+    edf->wrap.brk = allocate(&edm->alloc, sizeof(*edf->wrap.brk) * EDM_WRAP_BRKS);
+    edf->wrap.map = allocate(&edm->alloc, sizeof(*edf->wrap.map) * EDM_MAP_CKPTS);
+    edf->wrap.run = allocate(&edm->alloc, EDM_RUN_CELLS);
+    if (!edf->wrap.line || !edf->wrap.brk || !edf->wrap.map || !edf->wrap.run) {
+        log_error("Failed to allocate wrap cache for file %s", uri.data);
+        return NULL;
+    }
+    memset(edf->wrap.line, 0, sizeof(*edf->wrap.line) * EDM_WRAP_LINES);
+    create_anc(&edm->alloc, &edf->anc);
+    edf->cursor = anc_add(&edf->anc, 0, ANC_RIGHT);
+    if (!edf->cursor || edf_reserve_cursors(edf, 1)) {
+        log_error("Failed to create cursor for file %s", uri.data);
+        return NULL;
+    }
+    edf->csr[0] = edf->cursor;
+    edf->csr_cnt = 1;
+    edf->uri = uri;
+    edf->flags = EDF_SHWN;
+    edf->tab_w = EDM_TAB_WIDTH;
+    
+    edm->file_cnt += 1;
+    return edf;
+}
+
+internal int edf_loader_main(void *arg)
+{
+    struct edf_loader *ld = arg;
+    u64 k = (u64)SDL_AtomicGet(&ld->ready);
+    u64 n = k ? EDM_LOAD_BATCH : EDM_LOAD_FIRST;
+    
+    while(k < ld->chunk_cnt && !SDL_AtomicGet(&ld->stop)) {
+        u64 lim = (u64)SDL_AtomicGet(&ld->limit);
+        if (lim > ld->chunk_cnt)
+            lim = ld->chunk_cnt;
+        if (k >= lim) {
+            SDL_SemWait(ld->wake);
+            continue;
+        }
+        
+        u64 e = k + n < lim ? k + n : lim;
+        txb_count_chunks(ld->data, ld->lf, k, e);
+        k = e;
+        n = EDM_LOAD_BATCH;
+        SDL_AtomicSet(&ld->ready, (int)k); // full barrier, publishes the counts
+    }
+    return 0;
+}
+
+// Also resumes a loader that was stopped for a reload, since ready is kept.
+internal int edf_start_loader(struct editor_file *edf)
+{
+    struct edf_loader *ld = &edf->ld;
+    struct txb_buf *b = &edf->fb.buf[TXB_BI_ORIG];
+    
+    ld->data = b->data;
+    ld->lf = b->lf;
+    ld->chunk_cnt = b->cap >> TXB_LF_SHIFT;
+    SDL_AtomicSet(&ld->stop, 0);
+    if (!ld->wake && !(ld->wake = SDL_CreateSemaphore(0))) {
+        log_error("Failed to create loader semaphore - %s", SDL_GetError());
+        return -1;
+    }
+    
+    ld->thread = SDL_CreateThread(edf_loader_main, "edf_loader", ld);
+    if (!ld->thread) {
+        log_error("Failed to create loader thread - %s", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+internal void edf_stop_loader(struct editor_file *edf)
+{
+    if (!edf->ld.thread)
+        return;
+    SDL_AtomicSet(&edf->ld.stop, 1);
+    SDL_SemPost(edf->ld.wake);
+    SDL_WaitThread(edf->ld.thread, NULL);
+    edf->ld.thread = NULL;
+}
+
+// Whether the loader is counting chunks the main thread has asked for, or has counted
+// some that are not in the document yet, so that the main loop should keep polling it.
+internal bool edf_loading(struct editor_file *edf)
+{
+    struct edf_loader *ld = &edf->ld;
+    if (!ld->thread)
+        return false;
+    u64 k = (u64)SDL_AtomicGet(&ld->ready);
+    return k < (u64)SDL_AtomicGet(&ld->limit) || k == ld->chunk_cnt ||
+           k << TXB_LF_SHIFT > edf->fb.buf[TXB_BI_ORIG].size;
+}
+
+// Append what the loader has counted since the last frame to the document, and let it
+// count further once the view is within a screen of the end of the document.
+internal void edf_poll_loader(struct editor_file *edf)
+{
+    struct edf_loader *ld = &edf->ld;
+    if (txb_loaded(&edf->fb))
+        return;
+    
+    // loading appends to the last line
+    u64 last = txb_line_cnt(&edf->fb) - 1;
+    u64 last_len = txb_line_end(&edf->fb, last) - txb_line_start(&edf->fb, last);
+    
+    if (!ld->thread && edf_start_loader(edf)) {
+        log_error("Loading file %s on the main thread instead", edf->uri.data);
+        if (txb_load(&edf->fb, Max_u64))
+            log_error("Failed to load file %s", edf->uri.data);
+        edf_wrap_edit(edf, last, last_len, last, (s64)(txb_line_cnt(&edf->fb) - 1 - last));
+        return;
+    }
+    
+    u64 rows = edf_last_row(edf) + 1;
+    if (edf->top_line + 2 * rows + GPU_OVERSCAN >= txb_line_cnt(&edf->fb)) {
+        u64 lim = (edf->fb.buf[TXB_BI_ORIG].size >> TXB_LF_SHIFT) + EDM_LOAD_AHEAD;
+        if (lim > (u64)SDL_AtomicGet(&ld->limit)) {
+            SDL_AtomicSet(&ld->limit, (int)(lim < ld->chunk_cnt ? lim : ld->chunk_cnt));
+            SDL_SemPost(ld->wake);
+        }
+    }
+    
+    u64 k = (u64)SDL_AtomicGet(&ld->ready);
+    u64 pos = k == ld->chunk_cnt ? edf->fb.buf[TXB_BI_ORIG].cap : k << TXB_LF_SHIFT;
+    if (txb_load_indexed(&edf->fb, pos)) {
+        log_error("Failed to load file %s past %u", edf->uri.data, txb_size(&edf->fb));
+        return;
+    }
+    edf_wrap_edit(edf, last, last_len, last, (s64)(txb_line_cnt(&edf->fb) - 1 - last));
+    
+    if (k == ld->chunk_cnt) {
+        SDL_WaitThread(ld->thread, NULL);
+        ld->thread = NULL;
+    }
+}
+
+internal struct edf_jnl_hdr edm_make_jnl_hdr(const struct fio_map *m)
+{
+    const u8 *data = m->data;
+    u64 size = m->size;
+    
+    // fnv-1a over the first and last bytes, edits usually change the size or an end
+    u64 h = 0xcbf29ce484222325;
+    u64 n = size < EDM_JNL_HASH_SIZE ? size : EDM_JNL_HASH_SIZE;
+    for(u64 i=0; i < n; ++i)
+        h = (h ^ data[i]) * 0x100000001b3;
+    for(u64 i = size - n; i < size; ++i)
+        h = (h ^ data[i]) * 0x100000001b3;
+    
+    return (struct edf_jnl_hdr) {.magic = EDM_JNL_MAGIC, .size = size, .mtime = m->mtime, .hash = h};
+}
+
+internal char* edm_make_uri(struct string uri, const char *ext)
+{
+    u64 len = strlen(ext);
+    char *r = allocate(&edm->alloc, uri.size + len + 1);
+    if (!r)
+        return NULL;
+    memcpy(r, uri.data, uri.size);
+    memcpy(r + uri.size, ext, len + 1);
     return r;
 }
 
-static inline void edf_draw_cursor(struct editor_file *edf, struct edf_line_stat els)
+internal int edf_journal_open(struct editor_file *edf)
 {
-    struct rect_u16 c = edm_make_cursor_rect(els, edf->view.ofs);
-    struct rgba fg={},bg={};
+    struct edf_journal *j = &edf->jnl;
+    if (j->open)
+        return 0;
     
-    rgb_copy(&fg, &CSR_FG);
-    rgb_copy(&bg, &CSR_BG);
-    gpu_db_add(c, fg, bg);
+    if (fio_open_append(j->uri, false, &j->f)) {
+        log_error("Failed to open journal %s", j->uri);
+        return -1;
+    }
+    j->open = true;
+    
+    if (j->f.size == 0 && fio_append(&j->f, &j->hdr, sizeof(j->hdr))) {
+        log_error("Failed to write journal header to %s", j->uri);
+        return -1;
+    }
+    return 0;
 }
 
-static inline void edf_maybe_draw_cursor(struct editor_file *edf, struct edf_line_stat els)
+internal void edf_journal_flush(struct editor_file *edf)
 {
-    if (els.i != edf->cursor_pos)
+    struct edf_journal *j = &edf->jnl;
+    j->flush_ms = win_ms();
+    if (!j->used)
         return;
-    edf_draw_cursor(edf, els);
+    
+    if (edf_journal_open(edf) || fio_append(&j->f, j->buf, j->used))
+        log_error("Failed to write %u bytes of edits to journal %s", j->used, j->uri);
+    j->used = 0;
+    j->last = Max_u64;
 }
 
-def_create_edm(create_edm)
+// Append [pos,pos+len) of the document to the journal, straight to the file when dst
+// is NULL.
+internal int edf_journal_text(struct editor_file *edf, u64 pos, u64 len, u8 *dst)
+{
+    struct txb_iter it;
+    if (!len || !txb_iter_seek(&edf->fb, &it, pos))
+        return 0;
+    
+    const u8 *s = it.s + (pos - it.base);
+    do {
+        u64 n = (u64)(it.e - s) < len ? (u64)(it.e - s) : len;
+        if (dst) {
+            memcpy(dst, s, n);
+            dst += n;
+        } else if (fio_append(&edf->jnl.f, s, n)) {
+            return -1;
+        }
+        len -= n;
+        if (!len || !txb_iter_next(&it))
+            break;
+        s = it.s;
+    } while(true);
+    return 0;
+}
+
+// Buffer an edit for the journal, folding runs of typing and backspacing into the
+// previous record. Inserted text is read back from the document when data is NULL.
+internal void edf_journal(struct editor_file *edf, u64 ofs, u64 del, const u8 *data, u64 ins)
+{
+    struct edf_journal *j = &edf->jnl;
+    if (!j->uri)
+        return;
+    
+    struct edf_jnl_rec r;
+    if (j->last < j->used && (data || !ins)) {
+        memcpy(&r, j->buf + j->last, sizeof(r));
+        if (del == 0 && r.del == 0 && r.ofs + r.ins == ofs && j->used + ins <= EDM_JNL_BUF_SIZE) {
+            if (ins)
+                memcpy(j->buf + j->used, data, ins);
+            j->used += ins;
+            r.ins += ins;
+            memcpy(j->buf + j->last, &r, sizeof(r));
+            return;
+        }
+        if (ins == 0 && r.ins == 0 && ofs + del == r.ofs) {
+            r.ofs = ofs;
+            r.del += del;
+            memcpy(j->buf + j->last, &r, sizeof(r));
+            return;
+        }
+    }
+    
+    r = (struct edf_jnl_rec) {.ofs = ofs, .del = del, .ins = ins};
+    if (j->used + sizeof(r) + ins > EDM_JNL_BUF_SIZE)
+        edf_journal_flush(edf);
+    
+    if (sizeof(r) + ins > EDM_JNL_BUF_SIZE) {
+        if (edf_journal_open(edf) || fio_append(&j->f, &r, sizeof(r)) ||
+            (data ? fio_append(&j->f, data, ins) : edf_journal_text(edf, ofs, ins, NULL)))
+        {
+            log_error("Failed to write %u byte insert to journal %s", ins, j->uri);
+        }
+        return;
+    }
+    
+    j->last = j->used;
+    memcpy(j->buf + j->used, &r, sizeof(r));
+    if (data && ins)
+        memcpy(j->buf + j->used + sizeof(r), data, ins);
+    else
+        edf_journal_text(edf, ofs, ins, j->buf + j->used + sizeof(r));
+    j->used += sizeof(r) + ins;
+}
+
+// Apply the journal left behind by an earlier session, which then carries on
+// collecting this session's edits.
+internal void edf_replay_journal(struct editor_file *edf)
+{
+    struct edf_journal *j = &edf->jnl;
+    if (!fio_exists(j->uri))
+        return;
+    
+    struct fio_map m;
+    if (fio_map_file(j->uri, &m)) {
+        log_error("Failed to read journal %s", j->uri);
+        return;
+    }
+    
+    struct edf_jnl_hdr h = {};
+    if (m.size >= sizeof(h))
+        memcpy(&h, m.data, sizeof(h));
+    if (h.magic != EDM_JNL_MAGIC || h.size != j->hdr.size || h.mtime != j->hdr.mtime || h.hash != j->hdr.hash) {
+        log_error("Discarding journal %s, it was written for a different version of the file", j->uri);
+        fio_unmap_file(&m);
+        fio_delete(j->uri);
+        return;
+    }
+    
+    struct txb *t = &edf->fb;
+    struct txb_buf *ob = &t->buf[TXB_BI_ORIG];
+    u64 p = sizeof(h);
+    u64 cnt = 0;
+    bool failed = false;
+    while(m.size - p >= sizeof(struct edf_jnl_rec)) {
+        struct edf_jnl_rec r;
+        memcpy(&r, m.data + p, sizeof(r));
+        if (r.ins > m.size - p - sizeof(r))
+            break; // cut short by a crash
+        
+        u64 size = txb_size(t) + ob->cap - ob->size;
+        if (r.ofs > size || r.del > size - r.ofs) {
+            log_error("Journal %s has an edit past the end of the file at %u", j->uri, p);
+            failed = true;
+            break;
+        }
+        
+        // Edits apply to the whole file, so the part they touch must be loaded. Earlier
+        // edits move the document away from the original buffer, so it is loaded until
+        // the document is long enough rather than up to the offset.
+        while(txb_size(t) < r.ofs + r.del && !txb_loaded(t) && !failed)
+            failed = txb_load(t, ob->size + (r.ofs + r.del - txb_size(t))) != 0;
+        if (failed || txb_delete(t, r.ofs, r.del) || txb_insert(t, r.ofs, m.data + p + sizeof(r), r.ins)) {
+            failed = true;
+            break;
+        }
+        
+        p += sizeof(r) + r.ins;
+        cnt += 1;
+    }
+    
+    // The edits after one that did not apply are still in the journal, so it is kept as it
+    // is and this session does not journal over it.
+    if (failed) {
+        log_error("Recovered %u edits from journal %s before one at %u failed, the journal is kept and this session's edits will not be journaled", cnt, j->uri, p);
+        fio_unmap_file(&m);
+        j->uri = NULL;
+        return;
+    }
+    
+    // new records go straight after the last one, past the part a crash cut short
+    if (p < m.size) {
+        struct fio_span s = {.p = m.data, .len = p};
+        if (fio_write_atomic(j->uri, j->tmp_uri, NULL, &s, 1))
+            log_error("Failed to drop unusable end of journal %s", j->uri);
+    }
+    fio_unmap_file(&m);
+    
+    println("Recovered %u edits to %s from its journal", cnt, edf->uri.data);
+    edf_journal_open(edf);
+}
+
+// Once a save lands the saved file is what the journal applies to. Edits made while
+// the save was running are carried over behind a header for the new file.
+internal void edf_journal_rebase(struct editor_file *edf)
+{
+    struct edf_journal *j = &edf->jnl;
+    if (!j->uri)
+        return;
+    
+    struct fio_map m;
+    if (fio_map_file(edf->uri.data, &m)) {
+        log_error("Failed to read back saved file %s", edf->uri.data);
+        return;
+    }
+    struct edf_jnl_hdr h = edm_make_jnl_hdr(&m);
+    fio_unmap_file(&m);
+    
+    edf_journal_flush(edf);
+    if (j->open) {
+        fio_close(&j->f);
+        j->open = false;
+    }
+    j->hdr = h;
+    
+    if (!fio_exists(j->uri))
+        return;
+    if (fio_map_file(j->uri, &m)) {
+        log_error("Failed to read journal %s", j->uri);
+        return;
+    }
+    
+    u64 from = j->snap > sizeof(h) ? j->snap : sizeof(h);
+    u64 len = m.size > from ? m.size - from : 0;
+    u8 *tail = len ? allocate(&edm->save.alloc, len) : NULL;
+    if (tail)
+        memcpy(tail, m.data + from, len);
+    fio_unmap_file(&m);
+    
+    if (!len) {
+        fio_delete(j->uri);
+        return;
+    }
+    if (!tail) {
+        log_error("Failed to allocate %u bytes to carry journal %s over", len, j->uri);
+        return;
+    }
+    
+    struct fio_span s[] = {
+        {.p = (const u8*)&h, .len = sizeof(h)},
+        {.p = tail, .len = len},
+    };
+    if (fio_write_atomic(j->uri, j->tmp_uri, NULL, s, cl_array_size(s)))
+        log_error("Failed to carry journal %s over to the saved file", j->uri);
+}
+
+static inline struct edf_undo* edf_undo_at(struct edf_history *h, u32 i)
+{
+    return &h->e[(h->base + i) % EDM_UNDO_CNT];
+}
+
+internal void edf_undo_release(struct editor_file *edf, struct edf_undo *u)
+{
+    edf->hist.held_cnt -= txb_tree_cnt(u->held);
+    txb_release(&edf->fb, u->held);
+    u->held = NULL;
+}
+
+internal void edf_history_drop_oldest(struct editor_file *edf)
+{
+    struct edf_history *h = &edf->hist;
+    edf_undo_release(edf, edf_undo_at(h, 0));
+    h->base = (h->base + 1) % EDM_UNDO_CNT;
+    h->undo_cnt -= 1;
+}
+
+// Merge an edit into the last undo entry if it continues it: an edit that only replaces
+// text the entry put in, like typing at its end or backspace over what it typed, or a
+// run of backspace or delete at the same place.
+internal bool edf_history_merge(struct editor_file *edf, u64 ofs, u64 len, struct txb_node *held)
+{
+    struct edf_history *h = &edf->hist;
+    if (!h->undo_cnt)
+        return false;
+    
+    struct edf_undo *u = edf_undo_at(h, h->undo_cnt - 1);
+    u32 ms = win_ms();
+    if ((u->flags & EDF_UNDO_SEAL) || ms - u->ms >= EDM_UNDO_MERGE_MS)
+        return false;
+    
+    u64 n = txb_tree_len(held);
+    if (ofs >= u->ofs && ofs + n <= u->ofs + u->len) {
+        u->len = u->len - n + len;
+        h->held_cnt -= txb_tree_cnt(held);
+        txb_release(&edf->fb, held);
+    } else if (held && !len && !u->len && ofs + n == u->ofs) {
+        u->held = txb_join(&edf->fb, held, u->held);
+        u->ofs = ofs;
+    } else if (held && !len && !u->len && ofs == u->ofs) {
+        u->held = txb_join(&edf->fb, u->held, held);
+    } else {
+        return false;
+    }
+    u->ms = ms;
+    return true;
+}
+
+// Record that [ofs,ofs+len) replaced the detached pieces in held. Any redo entries are
+// discarded, and the oldest entries are dropped while the history is over budget.
+internal void edf_record(struct editor_file *edf, u64 ofs, u64 len, struct txb_node *held)
+{
+    struct edf_history *h = &edf->hist;
+    for(u32 i=0; i < h->redo_cnt; ++i)
+        edf_undo_release(edf, edf_undo_at(h, h->undo_cnt + i));
+    h->redo_cnt = 0;
+    
+    h->held_cnt += txb_tree_cnt(held);
+    if (edf_history_merge(edf, ofs, len, held))
+        return;
+    
+    if (h->undo_cnt == EDM_UNDO_CNT)
+        edf_history_drop_oldest(edf);
+    
+    *edf_undo_at(h, h->undo_cnt) = (struct edf_undo) {.ofs = ofs, .len = len, .held = held, .ms = win_ms()};
+    h->undo_cnt += 1;
+    
+    while(h->undo_cnt > 1 && h->held_cnt * sizeof(struct txb_node) > EDM_UNDO_NODE_BUDGET)
+        edf_history_drop_oldest(edf);
+}
+
+// Swap the pieces held by the last undo (or first redo) entry back into the document,
+// keeping what they replace in the entry so it can be flipped back.
+internal void edf_undo(struct editor_file *edf, bool redo)
+{
+    struct edf_history *h = &edf->hist;
+    if (redo ? !h->redo_cnt : !h->undo_cnt)
+        return;
+    
+    struct edf_undo *u = edf_undo_at(h, redo ? h->undo_cnt : h->undo_cnt - 1);
+    struct txb_node *out;
+    u64 del = u->len;
+    u64 ins = txb_tree_len(u->held);
+    u32 cnt = txb_tree_cnt(u->held);
+    struct txb_lc lc0 = txb_pos_to_lc(&edf->fb, u->ofs);
+    u64 l1 = txb_pos_to_lc(&edf->fb, u->ofs + del).line;
+    u64 lines = txb_line_cnt(&edf->fb);
+    
+    if (txb_swap(&edf->fb, u->ofs, u->len, u->held, &out)) {
+        log_error("Failed to %s edit at %u", redo ? "redo" : "undo", u->ofs);
+        return;
+    }
+    edf_wrap_edit(edf, lc0.line, lc0.col, l1, (s64)(txb_line_cnt(&edf->fb) - lines));
+    h->held_cnt = h->held_cnt - cnt + txb_tree_cnt(out);
+    u->len = ins;
+    u->held = out;
+    u->flags |= EDF_UNDO_SEAL;
+    
+    if (redo) {
+        h->undo_cnt += 1;
+        h->redo_cnt -= 1;
+    } else {
+        h->undo_cnt -= 1;
+        h->redo_cnt += 1;
+    }
+    anc_edit(&edf->anc, u->ofs, del, ins);
+    edf_single_cursor(edf);
+    anc_move(&edf->anc, edf->cursor, u->ofs + ins);
+    edf_journal(edf, u->ofs, del, NULL, ins);
+}
+
+// Replace each of the sorted, non-overlapping ranges [pos[i],pos[i]+del) with data. The
+// buffer rebuilds the whole batch in one pass and it becomes a single undo entry, so an
+// edit at thousands of cursors costs about as much as one piece per cursor.
+internal int edf_edit(struct editor_file *edf, const u64 *pos, u32 cnt, u64 del, const u8 *data, u64 len)
+{
+    if (!cnt || (!del && !len))
+        return 0;
+    
+    struct txb_lc lc0 = txb_pos_to_lc(&edf->fb, pos[0]);
+    u64 l1 = txb_pos_to_lc(&edf->fb, pos[cnt-1] + del).line;
+    u64 lines = txb_line_cnt(&edf->fb);
+    
+    struct txb_node *m;
+    if (txb_batch(&edf->fb, pos, cnt, del, data, len, &m)) {
+        log_error("Failed to edit %u bytes at %u cursors", del, cnt);
+        return -1;
+    }
+    edf_wrap_edit(edf, lc0.line, lc0.col, l1, (s64)(txb_line_cnt(&edf->fb) - lines));
+    
+    for(u32 i = cnt; i-- > 0;)
+        anc_edit(&edf->anc, pos[i], del, len);
+    edf_record(edf, pos[0], pos[cnt-1] + del - pos[0] - cnt * del + cnt * len, m);
+    
+    // ranges are journaled one by one, so each one is shifted by the ones before it
+    for(u32 i=0; i < cnt; ++i)
+        edf_journal(edf, pos[i] + i * len - i * del, del, data, len);
+    return 0;
+}
+
+internal int edm_saver_main(void *arg)
+{
+    struct edm_saver *sv = arg;
+    const struct txb_buf *ob = &sv->snap.buf[TXB_BI_ORIG];
+    struct txb_iter it = {};
+    u64 cnt = 1; // the part of the original buffer that is not loaded yet
+    for(bool ok = txb_iter_seek(&sv->snap, &it, 0); ok; ok = txb_iter_next(&it))
+        cnt += 1;
+    
+    sv->spans = allocate(&sv->alloc, sizeof(*sv->spans) * cnt);
+    if (!sv->spans) {
+        log_error("Failed to allocate %u spans for saving %s", cnt, sv->uri);
+        sv->result = -1;
+        SDL_AtomicSet(&sv->done, 1);
+        return 0;
+    }
+    
+    sv->span_cnt = 0;
+    for(bool ok = txb_iter_seek(&sv->snap, &it, 0); ok; ok = txb_iter_next(&it))
+        sv->spans[sv->span_cnt++] = (struct fio_span) {.p = it.s, .len = (u64)(it.e - it.s)};
+    if (sv->tail < ob->cap)
+        sv->spans[sv->span_cnt++] = (struct fio_span) {.p = ob->data + sv->tail, .len = ob->cap - sv->tail};
+    
+    sv->result = fio_write_atomic(sv->uri, sv->tmp_uri, sv->src, sv->spans, sv->span_cnt);
+    SDL_AtomicSet(&sv->done, 1);
+    return 0;
+}
+
+internal int edf_save(struct editor_file *edf)
 {
-    if (create_edf_array(16, &get_thread_alloc(MT).persist, &edm->edf)) {
-        log_error("Failed to create edm array");
+    struct edm_saver *sv = &edm->save;
+    if (sv->busy) {
+        log_error("Cannot save %s while a save is in progress", edf->uri.data);
+        return -1;
+    }
+    if (!edf->uri.size) {
+        log_error("Cannot save a file without a name");
+        return -1;
+    }
+    
+    // the journal up to here is covered by the snapshot
+    edf_journal_flush(edf);
+    edf->jnl.snap = edf->jnl.open ? edf->jnl.f.size : 0;
+    
+    reset_allocator(&sv->alloc);
+    sv->tmp_uri = allocate(&sv->alloc, edf->uri.size + sizeof(EDM_SAVE_TMP_EXT));
+    if (!sv->tmp_uri) {
+        log_error("Failed to allocate temporary file name for saving %s", edf->uri.data);
+        return -1;
+    }
+    
+    struct txb_buf *ob = &edf->fb.buf[TXB_BI_ORIG];
+    txb_snapshot(&edf->fb, &sv->snap);
+    sv->tail = ob->size;
+    sv->size = txb_size(&edf->fb) + ob->cap - ob->size;
+    sv->edf = edf;
+    sv->src = &edf->map;
+    sv->uri = edf->uri.data;
+    memcpy(sv->tmp_uri, edf->uri.data, edf->uri.size);
+    memcpy(sv->tmp_uri + edf->uri.size, EDM_SAVE_TMP_EXT, sizeof(EDM_SAVE_TMP_EXT));
+    SDL_AtomicSet(&sv->done, 0);
+    
+    sv->thread = SDL_CreateThread(edm_saver_main, "edm_saver", sv);
+    if (!sv->thread) {
+        log_error("Failed to create save thread - %s", SDL_GetError());
+        txb_drop(&edf->fb, &sv->snap);
         return -1;
     }
+    sv->busy = true;
     return 0;
 }
 
+internal void edm_poll_save(void)
+{
+    struct edm_saver *sv = &edm->save;
+    if (!sv->busy || !SDL_AtomicGet(&sv->done))
+        return;
+    
+    if (sv->thread) {
+        SDL_WaitThread(sv->thread, NULL);
+        sv->thread = NULL;
+    }
+    sv->busy = false;
+    txb_drop(&sv->edf->fb, &sv->snap);
+    
+    if (sv->result) {
+        log_error("Failed to save %s", sv->uri);
+        return;
+    }
+    println("Saved %s (%u bytes)", sv->uri, sv->size);
+    edf_journal_rebase(sv->edf);
+}
+
+// The file is mapped rather than read, and its contents stream into the document
+// from a loader thread, so opening it costs the same regardless of its size.
+internal struct editor_file* edm_open_file(const char *uri)
+{
+    struct fio_map m;
+    if (fio_map_file(uri, &m)) {
+        log_error("Failed to map file %s", uri);
+        return NULL;
+    }
+    
+    struct editor_file *edf = edm_create_file(create_string((char*)uri, strlen(uri)), (struct string) {.data = (char*)m.data, .size = m.size});
+    if (!edf) {
+        fio_unmap_file(&m);
+        return NULL;
+    }
+    edf->map = m;
+    
+    struct edf_journal *j = &edf->jnl;
+    j->uri = edm_make_uri(edf->uri, EDM_JNL_EXT);
+    j->tmp_uri = edm_make_uri(edf->uri, EDM_JNL_EXT EDM_SAVE_TMP_EXT);
+    j->buf = allocate(&edm->alloc, EDM_JNL_BUF_SIZE);
+    if (!j->uri || !j->tmp_uri || !j->buf) {
+        log_error("Failed to allocate journal for %s, edits will not be journaled", uri);
+        j->uri = NULL;
+    } else {
+        j->hdr = edm_make_jnl_hdr(&m);
+        edf_replay_journal(edf);
+    }
+    
+    // the first screen is usually ready by the first frame
+    if (!txb_loaded(&edf->fb)) {
+        SDL_AtomicSet(&edf->ld.ready, (int)(edf->fb.buf[TXB_BI_ORIG].size >> TXB_LF_SHIFT));
+        SDL_AtomicSet(&edf->ld.limit, SDL_AtomicGet(&edf->ld.ready) + EDM_LOAD_AHEAD);
+        if (edf_start_loader(edf))
+            log_error("Failed to start loading file %s", uri);
+    }
+    return edf;
+}
+
 char edm_test_string[] = "\
 Line 1: This is a line of text\n\
 Line 2: This is another line, but it has more letters\n\
@@ -169,87 +1487,116 @@ Line 3: This line has the line above appended to it in order to test long string
 Line 4: Now these lines will repeat, take a look!\n\
 ";
 
-internal void edf_draw_file(struct editor_file *edf)
+def_create_edm(create_edm)
 {
-    struct edf_line_stat els = {};
+    create_allocator_arena(EDM_ARENA_BLOCK_SIZE, &edm->alloc);
+    create_allocator_arena(EDM_ARENA_BLOCK_SIZE, &edm->save.alloc);
     
-    u64 view_pos = 0;
-    {
-        u16 i;
-        for(i = edf->view_pos.x; i < edf->cursor_pos; ++i) {
-            if (edf->fb.data[edf->cursor_pos - i] == '\n') {
-                i -= 1;
-                break;
-            }
+    struct editor_file *edf;
+    if (prg->open_uri) {
+        edf = edm_open_file(prg->open_uri);
+        if (!edf) {
+            log_error("Failed to open file %s", prg->open_uri);
+            return -1;
         }
-        els.ofs = i - edf->view_pos.x;
-        view_pos += els.ofs;
+    } else {
+        edf = edm_create_file((struct string) {}, CLSTR(edm_test_string));
+        if (!edf) {
+            log_error("Failed to create editor file for the test string");
+            return -1;
+        }
+        txb_load(&edf->fb, Max_u64);
+        edf->flags |= EDF_WRAP;
+        anc_move(&edf->anc, edf->cursor, 57);
     }
     
-    for(els.i = view_pos; els.i < edf->fb.size; edf_newcol(&els)) {
-        main_loop_start: // goto label
+    struct txb_lc lc = txb_pos_to_lc(&edf->fb, anc_pos(edf->cursor));
+    edf->view_pos.x = (u16)edf_byte_col(edf, lc.line, lc.col);
+    edf->view_pos.y = (u16)lc.line;
+    edm->active_file = 0;
+    return 0;
+}
+
+internal void edf_draw_file(struct editor_file *edf)
+{
+    struct edf_line_stat els = {};
+    struct txb_iter it = {.t = &edf->fb};
+    u64 size = txb_size(&edf->fb);
+    u64 ascii_end = 0;
+    
+    // view_pos is where the cursor sits in the view, so the first line and the
+    // horizontal scroll both fall out of the cursor's line and column.
+    els.csr = edf_cursor_pos(edf);
+    els.csr_end = els.csr + edf->csr_cnt;
+    struct txb_lc lc = txb_pos_to_lc(&edf->fb, anc_pos(edf->cursor));
+    u64 first = lc.line > edf->view_pos.y ? lc.line - edf->view_pos.y : 0;
+    
+    // A line keeps its grid row, line % rows, while it is in the band drawn around the
+    // view, so scrolling moves the view over the grid and only the rows entering the
+    // band are new. Wrapped lines have no fixed row, so wrapping draws from row 0.
+    if (!(edf->flags & EDF_WRAP)) {
+        u64 col = edf_byte_col(edf, lc.line, lc.col);
+        if (col > edf->view_pos.x)
+            els.ofs = col - edf->view_pos.x;
+        edf_scroll_to(edf, first);
+        
+        u64 band = first < GPU_OVERSCAN ? first : GPU_OVERSCAN;
+        u32 rows = (u32)band + edf_last_row(edf) + 1 + GPU_OVERSCAN;
+        if (rows > gpu->grid.rows)
+            rows = gpu->grid.rows;
         
-        if (is_whitechar(edf->fb.data[els.i])) {
+        els.row = (u16)((first - band) % gpu->grid.rows);
+        gpu->db.top = els.row;
+        gpu->db.shift[0] = 0;
+        gpu->db.shift[1] = edf->scroll_px - (s32)band * (gpu->cell.dim_px.h + GPU_ROW_PAD);
+        edf_line_begin(edf, &els, first - band);
+        edf_draw_rows(edf, &els, &it, rows);
+        return;
+    }
+    
+    edf->top_line = first;
+    edf->scroll_px = 0;
+    gpu->db.top = 0;
+    gpu->db.shift[0] = 0;
+    gpu->db.shift[1] = 0;
+    edf_line_begin(edf, &els, first);
+    
+    for(; els.i < size; edf_newcol(&els)) {
+        if (is_whitechar(txb_byte(&it, els.i))) {
             do {
                 // newline
-                u16 cnt = 0;
-                while(els.i < edf->fb.size && edf->fb.data[els.i] == '\n') {
-                    edf_maybe_draw_cursor(edf, els);
-                    els.i += 1;
-                    cnt += 1;
-                }
-                if (cnt) {
-                    els.row += cnt;
-                    els.i += els.ofs;
-                    els.col = 0;
+                while(els.i < size && txb_byte(&it, els.i) == '\n') {
+                    edf_maybe_draw_cursor(edf, &els);
+                    edf_newline(edf, &els);
+                    if (edf_will_wrap_h(edf, els.row))
+                        goto main_loop_end;
                 }
                 
-                // space
-                while(edf->fb.data[els.i] == ' ') {
-                    if (edf_will_wrap_w(edf, els.col)) {
-                        if (edf->flags & EDF_WRAP) {
-                            edf_virtual_newline(&els);
-                        } else {
-                            if (edf_next_line(edf, &els))
-                                goto main_loop_end;
-                            goto main_loop_start;
-                        }
-                    } else {
-                        edf_maybe_draw_cursor(edf, els);
+                // space, a tab to the next stop, and any other whitespace as a blank cell
+                while(txb_byte(&it, els.i) != '\n' && is_whitechar(txb_byte(&it, els.i))) {
+                    edf_maybe_break(&els);
+                    edf_maybe_draw_cursor(edf, &els);
+                    if (txb_byte(&it, els.i) == '\t')
+                        edf_newtab(edf, &els);
+                    else
                         edf_newcol(&els);
-                    }
                 }
-            } while(is_whitechar(edf->fb.data[els.i]));
+            } while(is_whitechar(txb_byte(&it, els.i)));
             
-            if (edf->flags & EDF_WRAP) {
-                u32 l = edf_word_len(edf, els);
-                if (edf_will_wrap_w(edf, els.col + l))
-                    edf_virtual_newline(&els);
+            if (els.i >= size) {
+                edf_maybe_draw_cursor(edf, &els);
+                break;
             }
         }
         
-        if (edf_will_wrap_w(edf, els.col)) {
-            if (edf->flags & EDF_WRAP) {
-                edf_virtual_newline(&els);
-            } else {
-                if (edf_next_line(edf, &els))
-                    goto main_loop_end;
-                goto main_loop_start;
-            }
-        }
+        edf_maybe_break(&els);
         if (edf_will_wrap_h(edf, els.row))
             break;
         
-        struct fgbg col = edm_char_col(edf->fb.data[els.i]);
-        struct rect_u16 r = edm_make_char_rect(els, edf->view.ofs, edf->fb.data[els.i]);
-        
-        if (els.i == edf->cursor_pos) {
-            edf_draw_cursor(edf, els);
-            rgb_copy(&col.fg, &CSR_FG);
-            rgb_copy(&col.bg, &CSR_BG);
-        }
-        
-        gpu_db_add(r, col.fg, col.bg);
+        u32 len;
+        u8 g = edf_glyph(&it, size, &ascii_end, els.i, &len);
+        edf_draw_glyph(edf, &els, g);
+        els.i += len - 1;
     }
     main_loop_end: // goto label
     return;
@@ -257,33 +1604,251 @@ internal void edf_draw_file(struct editor_file *edf)
 
 def_edm_update(edm_update)
 {
-    struct string data = CLSTR(edm_test_string);
+    edm_poll_save();
+    
+    for(u32 i=0; i < edm->file_cnt; ++i) {
+        struct edf_journal *j = &edm->edf[i].jnl;
+        if (j->used && win_ms() - j->flush_ms >= EDM_JNL_FLUSH_MS)
+            edf_journal_flush(&edm->edf[i]);
+    }
     
-    struct editor_file edf = {};
-    edf.flags = EDF_SHWN|EDF_WRAP;
-    edf.cursor_pos = 57;
+    if (edm->active_file >= edm->file_cnt)
+        return 0;
+    
+    struct editor_file *edf = &edm->edf[edm->active_file];
     
     u16 x = 100;
     u16 y = 50;
-    edf.view.ofs.x = x;
-    edf.view.ofs.y = y;
-    edf.view.ext.w = win->dim.w - x;
-    edf.view.ext.h = win->dim.h - y;
-    
-    edf.fb = data;
-    edf.uri = (struct string) {};
-    
-    u16 i;
-    for(i=0; i < edf.cursor_pos; ++i) {
-        if (edf.fb.data[edf.cursor_pos - i] == '\n') {
-            i -= 1;
+    edf->view.ofs.x = x;
+    edf->view.ofs.y = y;
+    edf->view.ext.w = win->dim.w - x;
+    edf->view.ext.h = win->dim.h - y;
+    gpu->db.org = edf->view.ofs;
+    
+    edf_poll_loader(edf);
+    
+    // the view may have shrunk since the cursor last moved
+    if (edf->view_pos.x > edf_last_col(edf))
+        edf->view_pos.x = edf_last_col(edf);
+    if (edf->view_pos.y > edf_last_row(edf))
+        edf->view_pos.y = edf_last_row(edf);
+    
+    edf_draw_file(edf);
+    
+    for(u32 i=0; i < edm->in_cnt; ++i)
+        gpu_db_add_input(edm->in_tick[i]);
+    edm->in_cnt = 0;
+    
+    return 0;
+}
+
+def_edm_wait_ms(edm_wait_ms)
+{
+    u32 ms = Max_u32;
+    if (edm->save.busy)
+        ms = EDM_POLL_MS;
+    if (edm->active_file < edm->file_cnt && edf_loading(&edm->edf[edm->active_file]))
+        ms = EDM_POLL_MS;
+    
+    u32 now = win_ms();
+    for(u32 i=0; i < edm->file_cnt; ++i) {
+        struct edf_journal *j = &edm->edf[i].jnl;
+        if (!j->used)
+            continue;
+        u32 t = now - j->flush_ms;
+        t = t < EDM_JNL_FLUSH_MS ? EDM_JNL_FLUSH_MS - t : 0;
+        if (t < ms)
+            ms = t;
+    }
+    return ms;
+}
+
+// Move pos off the continuation bytes of a UTF-8 sequence, back to its first byte or
+// forward past its last.
+internal u64 edf_char_start(struct editor_file *edf, u64 pos, bool forward)
+{
+    struct txb_iter it = {.t = &edf->fb};
+    u64 size = txb_size(&edf->fb);
+    for(u32 i=0; i < 3 && pos > 0 && pos < size && utf8_is_cont(txb_byte(&it, pos)); ++i)
+        pos = forward ? pos + 1 : pos - 1;
+    return pos;
+}
+
+// Offset of the char at column col of line, or of the end of the line if it is shorter.
+internal u64 edf_lc_pos(struct editor_file *edf, u64 line, u64 col)
+{
+    u64 at;
+    return txb_line_start(&edf->fb, line) + edf_col_byte(edf, line, col, &at);
+}
+
+// Where key moves a cursor that is on pos. Moving between lines keeps the column, so
+// tabs and chars of more than one byte do not pull it sideways.
+internal u64 edf_move(struct editor_file *edf, u64 pos, u16 key)
+{
+    struct txb_lc lc = txb_pos_to_lc(&edf->fb, pos);
+    if (key == KEY_UP || key == KEY_DOWN || key == KEY_PAGEUP || key == KEY_PAGEDOWN)
+        lc.col = edf_byte_col(edf, lc.line, lc.col);
+    switch(key) {
+        case KEY_LEFT:
+        return pos > 0 ? edf_char_start(edf, pos - 1, false) : pos;
+        
+        case KEY_RIGHT:
+        return pos < txb_size(&edf->fb) ? edf_char_start(edf, pos + 1, true) : pos;
+        
+        case KEY_UP:
+        return lc.line > 0 ? edf_lc_pos(edf, lc.line - 1, lc.col) : pos;
+        
+        case KEY_DOWN:
+        return lc.line + 1 < txb_line_cnt(&edf->fb) ? edf_lc_pos(edf, lc.line + 1, lc.col) : pos;
+        
+        case KEY_PAGEUP:
+        return edf_lc_pos(edf, lc.line > edf_last_row(edf) ? lc.line - edf_last_row(edf) : 0, lc.col);
+        
+        case KEY_PAGEDOWN:
+        return edf_lc_pos(edf, lc.line + edf_last_row(edf), lc.col);
+        
+        case KEY_HOME:
+        return pos - lc.col;
+        
+        case KEY_END:
+        return txb_line_end(&edf->fb, lc.line);
+    }
+    return pos;
+}
+
+// Shift the cursor's place in the view by however far it moved, scrolling when it
+// would leave the view. from_col is the column the cursor was at, found before the edit.
+internal void edf_follow_cursor(struct editor_file *edf, struct txb_lc from, u64 from_col)
+{
+    struct txb_lc to = txb_pos_to_lc(&edf->fb, anc_pos(edf->cursor));
+    s64 x = (s64)edf->view_pos.x + (s64)(edf_byte_col(edf, to.line, to.col) - from_col);
+    s64 y = (s64)edf->view_pos.y + (s64)(to.line - from.line);
+    
+    x = x < 0 ? 0 : x > edf_last_col(edf) ? edf_last_col(edf) : x;
+    y = y < 0 ? 0 : y > edf_last_row(edf) ? edf_last_row(edf) : y;
+    edf->view_pos.x = (u16)x;
+    edf->view_pos.y = (u16)y;
+}
+
+def_edm_input(edm_input)
+{
+    if (edm->active_file >= edm->file_cnt || (ki.mod & RELEASE))
+        return;
+    
+    // the next update draws this key, so it is the frame the key's latency ends at
+    if (edm->in_cnt < cl_array_size(edm->in_tick))
+        edm->in_tick[edm->in_cnt++] = ki.tick;
+    
+    struct editor_file *edf = &edm->edf[edm->active_file];
+    struct txb_lc lc = txb_pos_to_lc(&edf->fb, anc_pos(edf->cursor));
+    u64 col = edf_byte_col(edf, lc.line, lc.col);
+    u64 *pos = edf_cursor_pos(edf);
+    u32 cnt = edf->csr_cnt;
+    
+    if (ki.mod & CTRL) {
+        switch(ki.key) {
+            case KEY_S:
+            edf_save(edf);
+            break;
+            
+            case KEY_Z:
+            edf_undo(edf, ki.mod & SHIFT);
             break;
+            
+            case KEY_Y:
+            edf_undo(edf, true);
+            break;
+            
+            case KEY_C:
+            if (ki.mod & ALT)
+                edf_single_cursor(edf);
+            break;
+            
+            // tab stops every 2, 4 and 8 columns in turn, every line is mapped again
+            case KEY_T:
+            edf->tab_w = edf->tab_w >= EDM_TAB_MAX ? 2 : edf->tab_w * 2;
+            for(u32 i=0; i < EDM_WRAP_LINES; ++i)
+                edf->wrap.line[i].w = 0;
+            break;
+            
+            // add a cursor above the first or below the last one
+            case KEY_UP:
+            case KEY_DOWN: {
+                if (!(ki.mod & ALT))
+                    break;
+                u64 p = ki.key == KEY_UP ? pos[0] : pos[cnt-1];
+                u64 q = edf_move(edf, p, ki.key);
+                if (q != p && edf_add_cursor(edf, q))
+                    log_error("Failed to add cursor");
+            } break;
         }
+        edf_follow_cursor(edf, lc, col);
+        return;
     }
-    edf.view_pos.x = i - 4;
-    edf.view_pos.y = 0;
     
-    edf_draw_file(&edf);
+    switch(ki.key) {
+        case KEY_BACKSPACE:
+        case KEY_DELETE: {
+            // A batch deletes the same number of bytes at each cursor, and chars are 1 to 4
+            // bytes, so there is a batch per length. A cursor at the start of the file has
+            // nothing before it and one at the end nothing after it.
+            bool back = ki.key == KEY_BACKSPACE;
+            u64 size = txb_size(&edf->fb);
+            u8 *len = salloc(MT, cnt);
+            for(u32 i=0; i < cnt; ++i) {
+                if (back)
+                    len[i] = pos[i] ? (u8)(pos[i] - edf_char_start(edf, pos[i] - 1, false)) : 0;
+                else
+                    len[i] = pos[i] < size ? (u8)(edf_char_start(edf, pos[i] + 1, true) - pos[i]) : 0;
+            }
+            
+            // each batch moves the cursors after it, so positions are read again each time
+            for(u8 l=1; l <= 4; ++l) {
+                pos = edf_cursor_pos(edf);
+                u32 n = 0;
+                for(u32 i=0; i < cnt; ++i) {
+                    if (len[i] == l)
+                        pos[n++] = back ? pos[i] - l : pos[i];
+                }
+                edf_edit(edf, pos, n, l, NULL, 0);
+            }
+        } break;
+        
+        case KEY_LEFT:
+        case KEY_RIGHT:
+        case KEY_UP:
+        case KEY_DOWN:
+        case KEY_PAGEUP:
+        case KEY_PAGEDOWN:
+        case KEY_HOME:
+        case KEY_END:
+        for(u32 i=0; i < cnt; ++i) {
+            u64 p = edf_move(edf, pos[i], ki.key);
+            if (p != pos[i])
+                anc_move(&edf->anc, edf->csr[i], p);
+        }
+        break;
+        
+        default: {
+            char c = win_key_to_char(ki);
+            if (c <= 0)
+                break;
+            if (edf_edit(edf, pos, cnt, 0, (u8*)&c, 1))
+                log_error("Failed to insert char %c", c);
+        } break;
+    }
+    edf_merge_cursors(edf);
+    edf_follow_cursor(edf, lc, col);
+}
+
+def_edm_stop_workers(edm_stop_workers)
+{
+    for(u32 i=0; i < edm->file_cnt; ++i)
+        edf_stop_loader(&edm->edf[i]);
     
-    return 0;
+    // a save cannot be abandoned halfway, its result is picked up after the reload
+    if (edm->save.thread) {
+        SDL_WaitThread(edm->save.thread, NULL);
+        edm->save.thread = NULL;
+    }
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define EDM_H
 
 #include "../solh/sol.h"
+#include "win.h"
+#include "txb.h"
+#include "anc.h"
+#include "fio.h"
 
 enum edf_flags {
     EDF_SHWN = 0x01,
@@ -10,19 +14,200 @@ enum edf_flags {
     EDF_WRAP = 0x08,
 };
 
+enum edf_undo_flags {
+    EDF_UNDO_SEAL = 0x01, // closed to further merging
+};
+
+// Streams the original buffer of a mapped file in on a worker thread, counting its
+// newlines as it goes. The main thread appends whatever ready covers each frame. Counting
+// reads every page it covers, so the loader only runs up to limit, which the main thread
+// moves EDM_LOAD_AHEAD chunks past the end of the document when the view gets near it.
+// The file is only read as far as it has been looked at, plus that much.
+struct edf_loader {
+    SDL_Thread *thread;
+    SDL_sem *wake; // posted when limit moves or the loader should stop
+    SDL_atomic_t ready; // index chunks counted so far
+    SDL_atomic_t limit; // index chunks the loader may count up to
+    SDL_atomic_t stop;
+    const u8 *data;
+    u64 *lf;
+    u64 chunk_cnt;
+};
+
+// Identifies the file a journal applies to, from its size, last write time and a hash
+// of its ends.
+struct edf_jnl_hdr {
+    u32 magic;
+    u32 pad;
+    u64 size;
+    u64 mtime; // an edit in the middle that keeps the size only shows here
+    u64 hash;
+};
+
+// Followed by ins bytes of inserted text. Deletion happens before insertion.
+struct edf_jnl_rec {
+    u64 ofs;
+    u64 del;
+    u64 ins;
+};
+
+// Append-only log of the edits made since the file was last saved, replayed onto the
+// file when it is next opened. Records are buffered and written in batches, so the
+// i/o follows the typing rather than the file size.
+struct edf_journal {
+    char *uri; // NULL when the file is not journaled
+    char *tmp_uri;
+    struct fio_file f;
+    bool open;
+    struct edf_jnl_hdr hdr;
+    u8 *buf; // records not yet written
+    u64 used;
+    u64 last; // offset in buf of the last record
+    u64 snap; // journal size when the running save took its snapshot
+    u32 flush_ms;
+};
+
+// An edit, as the range it left in the document and the detached pieces that range
+// replaced. Undoing it swaps the pieces back in, which leaves what was taken out in
+// held for redo, so either way is a single O(log n) tree operation.
+struct edf_undo {
+    u64 ofs;
+    u64 len;
+    struct txb_node *held;
+    u32 ms; // last time an edit was merged into the entry
+    u32 flags;
+};
+
+// Ring of undo entries, oldest first, followed by the redo entries. Beyond the ring
+// itself, memory is the nodes held by the entries, and the oldest entries are dropped
+// to keep that under EDM_UNDO_NODE_BUDGET. The text the nodes point at is not counted:
+// it is in the add blocks or the mapped original, neither of which is freed while the
+// file is open, so dropping entries would not give any of it back.
+struct edf_history {
+    struct edf_undo *e;
+    u32 base; // ring index of the oldest entry
+    u32 undo_cnt;
+    u32 redo_cnt;
+    u64 held_cnt; // nodes held by all entries
+};
+
+// A char boundary of a line and the column it is at.
+struct edf_col {
+    u64 b; // offset from the start of the line
+    u64 c;
+};
+
+// Where the logical lines around the view break into visual lines when wrapped, so that
+// drawing wrapped text only has to follow the breaks, the column map of each line, and
+// the layout each line was last drawn with when not wrapped. Lines are held in a window
+// that follows the view. An edit clears the lines it touched and renumbers the ones after
+// it, and a line wrapped at another width or mapped with another tab width is redone when
+// it is next drawn.
+struct edf_wrap_line {
+    u16 w; // cols the line was wrapped at, 0 when it has to be wrapped again
+    u16 cnt; // breaks, one less than its visual lines
+    u32 brk; // index of its first break
+    u16 tab_w; // tab width the column map was made with, 0 when it has to be made again
+    u32 step; // columns between checkpoints
+    u32 map; // index of its first checkpoint in the column map
+    u32 map_cnt;
+    u64 end_b; // how far the map has counted the line, it is extended as columns past it are needed
+    u64 end_c;
+    u16 run_w; // view cols the line was laid out for, 0 when it has to be laid out again
+    u16 run_cnt; // cells of its layout, to the end of its last visible char
+    u16 run_tab_w;
+    u32 run; // index of its first cell in the run cache
+    u64 run_ofs; // column at the left edge of the view it was laid out for
+};
+
+struct edf_wrap {
+    struct edf_wrap_line *line; // EDM_WRAP_LINES lines starting at first
+    u32 *brk; // offsets from the start of a line to each of its visual lines but the first
+    struct edf_col *map; // checkpoints of each line, about a step of columns apart
+    u8 *run; // the glyph of each visible cell of each line, GPU_GLYPH_NONE for an empty one
+    u64 first;
+    u32 brk_used;
+    u32 map_used;
+    u32 run_used;
+};
+
 struct editor_file {
     u32 flags;
     struct offset_u16 view_pos; // distance in cells to cursor from the top left corner of the view
     struct rect_u16 view; // pixel region on screen that the view is rendered to
-    u64 cursor_pos; // char that the cursor is on
-    struct string fb; // file buffer
+    u64 top_line; // first line in the view when it was last drawn
+    s32 scroll_px; // how far the text is drawn from its place while a smooth scroll eases
+    u16 tab_w; // columns between tab stops
+    struct anc_node *cursor; // anchor on the char that the cursor the view follows is on
+    struct anc_node **csr; // all cursors, cursor included, sorted by position
+    u64 *csr_pos; // scratch for the positions of csr
+    u32 csr_cnt;
+    u32 csr_cap;
+    struct txb fb; // file buffer
+    struct anc anc; // positions that follow edits
+    struct fio_map map; // backs the original buffer of files opened from disk
+    struct edf_loader ld;
+    struct edf_journal jnl;
+    struct edf_history hist;
+    struct edf_wrap wrap;
     struct string uri;
 };
-def_typed_array(edf, struct editor_file)
+
+// Writes a snapshot of a file on a worker thread, which turns it into the list of spans
+// to write. The snapshot is dropped once the main loop has seen the result.
+struct edm_saver {
+    SDL_Thread *thread;
+    SDL_atomic_t done;
+    bool busy; // until the main loop has seen the result
+    int result;
+    struct editor_file *edf;
+    struct txb snap;
+    u64 tail; // start of the part of the original buffer that was not loaded yet
+    const struct fio_map *src; // file that original buffer spans can be copied from
+    struct fio_span *spans;
+    u64 span_cnt;
+    u64 size;
+    const char *uri;
+    char *tmp_uri;
+    allocator_t alloc; // reset for each save
+};
+
+#define EDM_MAX_FILES 16
+#define EDM_ARENA_BLOCK_SIZE mb(4) /* backs piece tree nodes and add blocks */
+#define EDM_LOAD_FIRST 16 /* chunks counted before the loader first publishes, about a screen */
+#define EDM_LOAD_BATCH 1024 /* chunks counted between later publishes */
+#define EDM_LOAD_AHEAD 4096 /* chunks counted past the end of the document when the view nears it, 16MB */
+#define EDM_SAVE_TMP_EXT ".tmp" /* appended to the file name for the file being written */
+#define EDM_CSR_CNT 64 /* initial capacity of the cursor array */
+#define EDM_UNDO_CNT 1024 /* undo entries per file */
+#define EDM_UNDO_NODE_BUDGET mb(4) /* bytes of piece nodes the undo entries of a file may hold, not counting their text */
+#define EDM_UNDO_MERGE_MS 1000 /* edits further apart than this get their own entry */
+#define EDM_WRAP_LINES 1024 /* logical lines in the wrap cache window */
+#define EDM_WRAP_ROWS 1024 /* visual lines wrapped per logical line, more than a view holds */
+#define EDM_WRAP_BRKS 16384 /* breaks held by the wrap cache before it starts over */
+#define EDM_MAP_CKPTS 65536 /* column map checkpoints held by the wrap cache before it starts over */
+#define EDM_MAP_STEP 64 /* columns between the checkpoints of a line */
+#define EDM_MAP_LINE_CKPTS 4096 /* checkpoints of a line before its step doubles */
+#define EDM_RUN_CELLS mb(1) /* cells of line layouts held by the run cache before it starts over */
+#define EDM_TAB_WIDTH 4
+#define EDM_TAB_MAX 8 /* ctrl+t doubles the tab width up to this and then goes back to 2 */
+#define EDM_JNL_EXT ".jnl" /* appended to the file name for its journal */
+#define EDM_JNL_MAGIC 0x324a4445 /* "EDJ2" */
+#define EDM_JNL_BUF_SIZE kb(64) /* journal records buffered before a write is forced */
+#define EDM_JNL_FLUSH_MS 250 /* max time records stay buffered */
+#define EDM_JNL_HASH_SIZE kb(4) /* bytes from each end of a file that identify it */
+#define EDM_POLL_MS 16 /* wait between polls of a running loader or save */
+#define EDM_SCROLL_EASE 4 /* a smooth scroll covers 1/this of what is left each frame */
+#define EDM_SCROLL_STEP_MS 8 /* time between the frames of a smooth scroll */
 
 struct edm {
+    allocator_t alloc; // never reset, editor files outlive frames
     u32 active_file;
-    edf_array_t edf;
+    u32 file_cnt;
+    struct editor_file edf[EDM_MAX_FILES]; // fixed so that file addresses are stable
+    struct edm_saver save;
+    u64 in_tick[KEY_BUFFER_SIZE]; // arrival of the keys handled since the last update
+    u32 in_cnt;
 };
 
 #ifdef LIB
@@ -33,6 +218,17 @@ def_create_edm(create_edm);
 
 #define def_edm_update(name) int edm_update(void)
 def_edm_update(edm_update);
+
+#define def_edm_input(name) void name(struct keyboard_input ki)
+def_edm_input(edm_input);
+
+// How long the editor can go without an update, Max_u32 if it has nothing pending.
+#define def_edm_wait_ms(name) u32 name(void)
+def_edm_wait_ms(edm_wait_ms);
+
+// Worker threads run lib code, so they must be stopped before the lib is reloaded.
+#define def_edm_stop_workers(name) void name(void)
+def_edm_stop_workers(edm_stop_workers);
 #endif // LIB
 
 #endif // EDM_H
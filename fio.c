@@ -0,0 +1,421 @@
+#include "fio.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+def_fio_map_file(fio_map_file)
+{
+    memset(m, 0, sizeof(*m));
+    
+    // share delete so that a save can move the file aside while it is mapped
+    HANDLE fh = CreateFileA(uri, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open file %s (%u)", uri, GetLastError());
+        return -1;
+    }
+    
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(fh, &sz)) {
+        log_error("Failed to get size of file %s (%u)", uri, GetLastError());
+        CloseHandle(fh);
+        return -1;
+    }
+    
+    FILETIME ft;
+    if (GetFileTime(fh, NULL, NULL, &ft))
+        m->mtime = ((u64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    
+    // empty files cannot be mapped
+    if (sz.QuadPart == 0) {
+        CloseHandle(fh);
+        return 0;
+    }
+    
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mh) {
+        log_error("Failed to create mapping for file %s (%u)", uri, GetLastError());
+        CloseHandle(fh);
+        return -1;
+    }
+    
+    void *p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (!p) {
+        log_error("Failed to map view of file %s (%u)", uri, GetLastError());
+        CloseHandle(mh);
+        CloseHandle(fh);
+        return -1;
+    }
+    
+    m->data = p;
+    m->size = (u64)sz.QuadPart;
+    m->fh = fh;
+    m->mh = mh;
+    return 0;
+}
+
+def_fio_unmap_file(fio_unmap_file)
+{
+    // a save moved the file aside if it now ends in FIO_OLD_EXT, and it goes with the map
+    char path[MAX_PATH];
+    DWORD n = m->fh ? GetFinalPathNameByHandleA(m->fh, path, sizeof(path), 0) : 0;
+    u64 ext = sizeof(FIO_OLD_EXT) - 1;
+    bool old = n > ext && n < sizeof(path) && memcmp(path + n - ext, FIO_OLD_EXT, ext) == 0;
+    
+    if (m->data)
+        UnmapViewOfFile(m->data);
+    if (m->mh)
+        CloseHandle(m->mh);
+    if (m->fh)
+        CloseHandle(m->fh);
+    memset(m, 0, sizeof(*m));
+    
+    if (old && !DeleteFileA(path))
+        log_error("Failed to delete %s (%u)", path, GetLastError());
+}
+
+def_fio_map_anon(fio_map_anon)
+{
+    void *p = VirtualAlloc(NULL, (SIZE_T)size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+        log_error("Failed to map %u bytes of memory (%u)", size, GetLastError());
+    return p;
+}
+
+def_fio_exists(fio_exists)
+{
+    return GetFileAttributesA(uri) != INVALID_FILE_ATTRIBUTES;
+}
+
+def_fio_delete(fio_delete)
+{
+    if (!DeleteFileA(uri)) {
+        log_error("Failed to delete file %s (%u)", uri, GetLastError());
+        return -1;
+    }
+    return 0;
+}
+
+def_fio_open_append(fio_open_append)
+{
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+    
+    HANDLE fh = CreateFileA(uri, GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_DELETE, NULL, trunc ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open file %s (%u)", uri, GetLastError());
+        return -1;
+    }
+    
+    LARGE_INTEGER sz;
+    if (!SetFilePointerEx(fh, (LARGE_INTEGER) {}, &sz, FILE_END)) {
+        log_error("Failed to seek to the end of file %s (%u)", uri, GetLastError());
+        CloseHandle(fh);
+        return -1;
+    }
+    f->fh = fh;
+    f->size = (u64)sz.QuadPart;
+    return 0;
+}
+
+def_fio_append(fio_append)
+{
+    const u8 *b = p;
+    while(len) {
+        DWORD w, n = len > mb(64) ? mb(64) : (DWORD)len;
+        if (!WriteFile(f->fh, b, n, &w, NULL)) {
+            log_error("Failed to append to file (%u)", GetLastError());
+            return -1;
+        }
+        b += w;
+        len -= w;
+        f->size += w;
+    }
+    return 0;
+}
+
+def_fio_close(fio_close)
+{
+    if (f->fh)
+        CloseHandle(f->fh);
+    f->fh = NULL;
+}
+
+def_fio_write_atomic(fio_write_atomic)
+{
+    HANDLE fh = CreateFileA(tmp_uri, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        log_error("Failed to create file %s (%u)", tmp_uri, GetLastError());
+        return -1;
+    }
+    
+    for(u64 i=0; i < cnt; ++i) {
+        const u8 *p = spans[i].p;
+        u64 len = spans[i].len;
+        while(len) {
+            DWORD w, n = len > mb(64) ? mb(64) : (DWORD)len;
+            if (!WriteFile(fh, p, n, &w, NULL)) {
+                log_error("Failed to write file %s (%u)", tmp_uri, GetLastError());
+                goto fail;
+            }
+            p += w;
+            len -= w;
+        }
+    }
+    
+    if (!FlushFileBuffers(fh)) {
+        log_error("Failed to flush file %s (%u)", tmp_uri, GetLastError());
+        goto fail;
+    }
+    CloseHandle(fh);
+    
+    if (MoveFileExA(tmp_uri, uri, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH))
+        return 0;
+    
+    // A file with a mapped view, such as the one being edited, cannot be replaced or
+    // deleted, but it can be renamed. It moves aside so the new file can take its name,
+    // and fio_unmap_file deletes it once nothing maps it.
+    DWORD err = GetLastError();
+    char old[MAX_PATH];
+    u64 len = strlen(uri);
+    if ((err != ERROR_USER_MAPPED_FILE && err != ERROR_ACCESS_DENIED) || len + sizeof(FIO_OLD_EXT) > sizeof(old)) {
+        log_error("Failed to replace file %s with %s (%u)", uri, tmp_uri, err);
+        DeleteFileA(tmp_uri);
+        return -1;
+    }
+    memcpy(old, uri, len);
+    memcpy(old + len, FIO_OLD_EXT, sizeof(FIO_OLD_EXT));
+    if (!MoveFileExA(uri, old, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)) {
+        log_error("Failed to move mapped file %s aside to %s (%u)", uri, old, GetLastError());
+        DeleteFileA(tmp_uri);
+        return -1;
+    }
+    if (!MoveFileExA(tmp_uri, uri, MOVEFILE_WRITE_THROUGH)) {
+        log_error("Failed to replace file %s with %s (%u)", uri, tmp_uri, GetLastError());
+        MoveFileExA(old, uri, MOVEFILE_WRITE_THROUGH);
+        DeleteFileA(tmp_uri);
+        return -1;
+    }
+    return 0;
+    
+    fail:
+    CloseHandle(fh);
+    DeleteFileA(tmp_uri);
+    return -1;
+}
+
+#else
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h> // copy_file_range without needing _GNU_SOURCE
+#endif
+
+def_fio_map_file(fio_map_file)
+{
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+    
+    int fd = open(uri, O_RDONLY);
+    if (fd < 0) {
+        log_error("Failed to open file %s", uri);
+        return -1;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st)) {
+        log_error("Failed to get size of file %s", uri);
+        close(fd);
+        return -1;
+    }
+#ifdef __linux__
+    m->mtime = (u64)st.st_mtim.tv_sec * 1000000000 + (u64)st.st_mtim.tv_nsec;
+#else
+    m->mtime = (u64)st.st_mtime;
+#endif
+    
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        log_error("Failed to map file %s", uri);
+        close(fd);
+        return -1;
+    }
+    
+    m->data = p;
+    m->size = (u64)st.st_size;
+    m->fd = fd;
+    return 0;
+}
+
+def_fio_unmap_file(fio_unmap_file)
+{
+    if (m->data)
+        munmap((void*)m->data, m->size);
+    if (m->fd >= 0)
+        close(m->fd);
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+}
+
+def_fio_map_anon(fio_map_anon)
+{
+    void *p = mmap(NULL, (size_t)size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        log_error("Failed to map %u bytes of memory", size);
+        return NULL;
+    }
+    return p;
+}
+
+def_fio_exists(fio_exists)
+{
+    return access(uri, F_OK) == 0;
+}
+
+def_fio_delete(fio_delete)
+{
+    if (unlink(uri)) {
+        log_error("Failed to delete file %s", uri);
+        return -1;
+    }
+    return 0;
+}
+
+def_fio_open_append(fio_open_append)
+{
+    memset(f, 0, sizeof(*f));
+    f->fd = open(uri, O_WRONLY|O_CREAT|O_APPEND|(trunc ? O_TRUNC : 0), 0644);
+    if (f->fd < 0) {
+        log_error("Failed to open file %s", uri);
+        return -1;
+    }
+    
+    struct stat st;
+    if (fstat(f->fd, &st)) {
+        log_error("Failed to get size of file %s", uri);
+        close(f->fd);
+        f->fd = -1;
+        return -1;
+    }
+    f->size = (u64)st.st_size;
+    return 0;
+}
+
+def_fio_append(fio_append)
+{
+    const u8 *b = p;
+    while(len) {
+        ssize_t w = write(f->fd, b, len > mb(64) ? mb(64) : len);
+        if (w < 0) {
+            log_error("Failed to append to file");
+            return -1;
+        }
+        b += w;
+        len -= (u64)w;
+        f->size += (u64)w;
+    }
+    return 0;
+}
+
+def_fio_close(fio_close)
+{
+    if (f->fd >= 0)
+        close(f->fd);
+    f->fd = -1;
+}
+
+// Write a span to fd. A span of the source file is handed to copy_file_range first,
+// which lets the kernel copy it without going through user space, or share extents
+// on filesystems that support reflinks. Whatever it does not copy is written from
+// memory.
+internal int fio_write_span(int fd, const struct fio_map *src, const u8 *p, u64 len)
+{
+#ifdef __linux__
+    if (src && src->fd >= 0 && p >= src->data && p + len <= src->data + src->size) {
+        loff_t ofs = (loff_t)(p - src->data);
+        while(len) {
+            ssize_t c = syscall(SYS_copy_file_range, src->fd, &ofs, fd, NULL, (size_t)len, 0);
+            if (c <= 0)
+                break;
+            p += c;
+            len -= (u64)c;
+        }
+    }
+#endif
+    
+    while(len) {
+        ssize_t w = write(fd, p, len > mb(64) ? mb(64) : len);
+        if (w < 0)
+            return -1;
+        p += w;
+        len -= (u64)w;
+    }
+    return 0;
+}
+def_fio_write_atomic(fio_write_atomic)
+{
+    int fd = open(tmp_uri, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) {
+        log_error("Failed to create file %s", tmp_uri);
+        return -1;
+    }
+    
+    // The temp file is a new inode, so it takes the owner and mode of the file it
+    // replaces. Only root can give a file away, so the owner is kept where allowed, and
+    // otherwise the group if the saver is in it. The mode goes last as chown clears
+    // the set-id bits.
+    struct stat st;
+    if (stat(uri, &st) == 0) {
+        if (fchown(fd, st.st_uid, st.st_gid) && fchown(fd, (uid_t)-1, st.st_gid)) {
+            // left as the saver's own
+        }
+        if (fchmod(fd, st.st_mode & 07777)) {
+            log_error("Failed to give file %s the mode of %s", tmp_uri, uri);
+            goto fail;
+        }
+    }
+    
+    for(u64 i=0; i < cnt; ++i) {
+        if (fio_write_span(fd, src, spans[i].p, spans[i].len)) {
+            log_error("Failed to write file %s", tmp_uri);
+            goto fail;
+        }
+    }
+    
+    if (fsync(fd)) {
+        log_error("Failed to flush file %s", tmp_uri);
+        goto fail;
+    }
+    close(fd);
+    
+    if (rename(tmp_uri, uri)) {
+        log_error("Failed to replace file %s with %s", uri, tmp_uri);
+        unlink(tmp_uri);
+        return -1;
+    }
+    
+    // the rename itself is only durable once the directory is flushed
+    char dir[4096];
+    strncpy(dir, uri, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+    int dfd = open(dirname(dir), O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+    
+    fail:
+    close(fd);
+    unlink(tmp_uri);
+    return -1;
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef FIO_H
+#define FIO_H
+
+#include "../solh/sol.h"
+
+#define FIO_OLD_EXT ".old" /* appended to the name of a mapped file that a save on windows moves aside */
+
+// Read-only view of a whole file. The OS faults pages in as they are first read, so
+// mapping a file costs the same regardless of its size.
+struct fio_map {
+    const u8 *data;
+    u64 size;
+    u64 mtime; // last write time, in the platform's units
+    void *fh,*mh; // windows file and mapping handles
+    int fd; // posix file descriptor, kept open so saves can copy from the file directly
+};
+
+// File that is only ever appended to.
+struct fio_file {
+    void *fh;
+    int fd;
+    u64 size;
+};
+
+struct fio_span {
+    const u8 *p;
+    u64 len;
+};
+
+#ifdef LIB
+#define def_fio_map_file(name) int name(const char *uri, struct fio_map *m)
+def_fio_map_file(fio_map_file);
+
+#define def_fio_unmap_file(name) void name(struct fio_map *m)
+def_fio_unmap_file(fio_unmap_file);
+
+// Zeroed memory straight from the OS, for buffers too big for an arena block. Pages are
+// only made resident as they are first touched.
+#define def_fio_map_anon(name) void* name(u64 size)
+def_fio_map_anon(fio_map_anon);
+
+// Open uri for appending, creating it if needed, or emptying it if trunc.
+#define def_fio_open_append(name) int name(const char *uri, bool trunc, struct fio_file *f)
+def_fio_open_append(fio_open_append);
+
+#define def_fio_append(name) int name(struct fio_file *f, const void *p, u64 len)
+def_fio_append(fio_append);
+
+#define def_fio_close(name) void name(struct fio_file *f)
+def_fio_close(fio_close);
+
+// Write the spans to tmp_uri, flush it to disk and rename it over uri, so that uri
+// holds either its old contents or all of the new ones. Spans that lie in src, which
+// may be NULL, are copied from its file by the kernel where the platform allows it.
+#define def_fio_write_atomic(name) int name(const char *uri, const char *tmp_uri, const struct fio_map *src, const struct fio_span *spans, u64 cnt)
+def_fio_write_atomic(fio_write_atomic);
+
+#define def_fio_exists(name) bool name(const char *uri)
+def_fio_exists(fio_exists);
+
+#define def_fio_delete(name) int name(const char *uri)
+def_fio_delete(fio_delete);
+#endif // LIB
+
+#endif // FIO_H
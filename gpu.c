@@ -14,18 +14,22 @@ struct gpu *gpu;
 u32 frm_i = 0;
 static inline void gpu_inc_frame(void)
 {
-    frm_i = (frm_i + 1) % FRAME_WRAP;
+    frm_i = (frm_i + 1) % gpu->frames;
 }
 
 u32 gpu_bi_to_mi[GPU_BUF_CNT] = {
     [GPU_BI_G] = GPU_MI_G,
     [GPU_BI_T] = GPU_MI_T,
+    [GPU_BI_U] = GPU_MI_U,
+    [GPU_BI_C] = GPU_MI_C,
 };
 
 char* gpu_mem_names[GPU_MEM_CNT] = {
     [GPU_MI_G] = "Vertex",
     [GPU_MI_T] = "Transfer",
     [GPU_MI_I] = "Image",
+    [GPU_MI_U] = "Uniform",
+    [GPU_MI_C] = "Grid",
 };
 
 char *gpu_cmdq_names[GPU_CMD_CNT] = {
@@ -52,7 +56,9 @@ internal int gpu_memreq_helper(union gpu_memreq_info info, u32 i, VkMemoryRequir
         } return 0;
         
         case GPU_MI_G:
-        case GPU_MI_T: {
+        case GPU_MI_T:
+        case GPU_MI_U:
+        case GPU_MI_C: {
             VkBuffer buf;
             if (vk_create_buf(info.buf, &buf))
                 break;
@@ -90,6 +96,9 @@ internal u32 gpu_memtype_helper(u32 type_bits, u32 req)
 
 #define gpu_buf_align(sz) align(sz, gpu->props.limits.optimalBufferCopyOffsetAlignment)
 
+// Frames can start from a copy of the last one if the swapchain images can be copied.
+#define gpu_can_reuse() (!MSAA && (gpu->sc.info.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+
 internal u64 gpu_buf_alloc(u32 bi, u64 sz)
 {
     sz = gpu_buf_align(sz);
@@ -119,6 +128,93 @@ internal u64 gpu_bufcpy(VkCommandBuffer cmd, u64 ofs, u64 sz, u32 bi_from, u32 b
     return r.dstOffset;
 }
 
+internal void gpu_grid_clear(void)
+{
+    struct draw_info e = {.glyph = GPU_GLYPH_NONE};
+    u32 cnt = gpu->grid.cols * gpu->grid.rows;
+    for(u32 i=0; i < cnt; ++i)
+        gpu->grid.next[i] = e;
+    gpu->grid.used = 0;
+}
+
+// Stage the grid rows that changed since the last upload and copy them into GPU_BI_C.
+// Runs of changed rows become one region each. The copy is ordered after the draws of
+// earlier frames that read the grid, and before this frame's.
+internal int gpu_grid_sync(VkCommandBuffer cmd)
+{
+    struct gpu_grid *grid = &gpu->grid;
+    u64 row_sz = sizeof(*grid->cell) * grid->cols;
+    VkBufferCopy *r = salloc(MT, sizeof(*r) * grid->rows);
+    u32 cnt = 0;
+    u64 sz = 0;
+    for(u32 i=0; i < grid->rows; ++i) {
+        struct draw_info *next = grid->next + i * grid->cols;
+        struct draw_info *cell = grid->cell + i * grid->cols;
+        if (!grid->stale && memcmp(next, cell, row_sz) == 0)
+            continue;
+        memcpy(cell, next, row_sz);
+        if (cnt && r[cnt-1].dstOffset + r[cnt-1].size == i * row_sz) {
+            r[cnt-1].size += row_sz;
+        } else {
+            r[cnt].dstOffset = i * row_sz;
+            r[cnt].size = row_sz;
+            cnt += 1;
+        }
+        sz += row_sz;
+    }
+    grid->stale = false;
+    gpu_grid_clear();
+    
+    if (cnt == 0)
+        return 0;
+    
+    u64 ofs = gpu_buf_alloc(GPU_BI_T, sz);
+    if (ofs == Max_u64) {
+        log_error("Failed to stage %u bytes of cell grid rows", sz);
+        grid->stale = true; // try every row again next frame
+        return -1;
+    }
+    for(u32 i=0; i < cnt; ++i) {
+        r[i].srcOffset = ofs;
+        memcpy((u8*)gpu->buf[GPU_BI_T].data + ofs, (u8*)grid->cell + r[i].dstOffset, r[i].size);
+        ofs += r[i].size;
+    }
+    
+    enum {PRE,POST};
+    VkMemoryBarrier2 barr[] = {
+        [PRE] = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        },
+        [POST] = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+            .dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+        },
+    };
+    VkDependencyInfo dep[] = {
+        [PRE] = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &barr[PRE],
+        },
+        [POST] = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &barr[POST],
+        },
+    };
+    
+    vk_cmd_pl_barr(cmd, &dep[PRE]);
+    vk_cmd_bufcpy(cmd, cnt, r, gpu->buf[GPU_BI_T].handle, gpu->buf[GPU_BI_C].handle);
+    vk_cmd_pl_barr(cmd, &dep[POST]);
+    return 0;
+}
+
 internal u32 gpu_alloc_cmds(u32 ci, u32 cnt)
 {
     if (cnt == 0) return Max_u32;
@@ -156,7 +252,7 @@ internal void gpu_db_reset_fence(u32 i)
 
 internal void gpu_db_await_and_reset_in_use_fences(void)
 {
-    VkFence f[FRAME_WRAP];
+    VkFence f[GPU_MAX_FRAMES];
     u32 cnt,i;
     for_bits(i, cnt, gpu->db.in_use_fences)
         f[cnt] = gpu->db.fence[i];
@@ -166,6 +262,49 @@ internal void gpu_db_await_and_reset_in_use_fences(void)
     }
 }
 
+// Glyph metrics and palette for the vertex shader. They only change with the font, and
+// the buffer is remade along with the others, so no frame can be reading it.
+internal void gpu_write_ubo(void)
+{
+    struct gpu_ubo *u = gpu->buf[GPU_BI_U].data;
+    memset(u, 0, sizeof(*u));
+    for(u32 i=0; i < CHT_SZ; ++i) {
+        u->glyph[i][0] = gpu->glyph[i].x;
+        u->glyph[i][1] = gpu->glyph[i].y;
+        u->glyph[i][2] = gpu->glyph[i].w;
+        u->glyph[i][3] = gpu->glyph[i].h;
+    }
+    u->glyph[GPU_GLYPH_BLOCK][0] = 0;
+    u->glyph[GPU_GLYPH_BLOCK][1] = gpu->cell.y_ofs - GPU_BLOCK_PAD;
+    u->glyph[GPU_GLYPH_BLOCK][2] = gpu->cell.dim_px.w;
+    u->glyph[GPU_GLYPH_BLOCK][3] = gpu->cell.dim_px.h + GPU_BLOCK_PAD;
+    
+    // a redrawn row has to cover every pixel any glyph in it could have drawn
+    gpu->cell.ink[0] = u->glyph[GPU_GLYPH_BLOCK][1];
+    gpu->cell.ink[1] = u->glyph[GPU_GLYPH_BLOCK][1] + u->glyph[GPU_GLYPH_BLOCK][3];
+    for(u32 i=0; i < CHT_SZ; ++i) {
+        if (gpu->glyph[i].h == 0)
+            continue;
+        if (gpu->glyph[i].y < gpu->cell.ink[0])
+            gpu->cell.ink[0] = gpu->glyph[i].y;
+        if (gpu->glyph[i].y + gpu->glyph[i].h > gpu->cell.ink[1])
+            gpu->cell.ink[1] = gpu->glyph[i].y + gpu->glyph[i].h;
+    }
+    
+    struct rgba pal[SH_PAL_CNT][2] = {
+        [GPU_PAL_TEXT] = {FG_COL, BG_COL},
+        [GPU_PAL_CSR] = {CSR_FG, CSR_BG},
+    };
+    for(u32 i=0; i < SH_PAL_CNT; ++i) {
+        for(u32 j=0; j < 2; ++j) {
+            u->pal[i][j][0] = pal[i][j].r / 255.0f;
+            u->pal[i][j][1] = pal[i][j].g / 255.0f;
+            u->pal[i][j][2] = pal[i][j].b / 255.0f;
+            u->pal[i][j][3] = pal[i][j].a / 255.0f;
+        }
+    }
+}
+
 internal int gpu_create_mem(void)
 {
     local_persist VkImageCreateInfo ici = {
@@ -191,6 +330,16 @@ internal int gpu_create_mem(void)
             .size = 1,
             .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         },
+        [GPU_BI_U] = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = 1,
+            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        },
+        [GPU_BI_C] = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = 1,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        },
     };
     
     if ((gpu->flags & GPU_MEM_INI) == false) { // runs once per program
@@ -231,6 +380,8 @@ internal int gpu_create_mem(void)
         union gpu_memreq_info mr_infos[GPU_MEM_CNT] = {
             [GPU_MI_G] = {.buf = &bci[GPU_BI_G]},
             [GPU_MI_T] = {.buf = &bci[GPU_BI_T]},
+            [GPU_MI_U] = {.buf = &bci[GPU_BI_U]},
+            [GPU_MI_C] = {.buf = &bci[GPU_BI_C]},
             [GPU_MI_I] = {.img = &ici},
             [GPU_MI_R] = {.img = &ici},
         };
@@ -250,6 +401,8 @@ internal int gpu_create_mem(void)
             [GPU_MI_R] = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             [GPU_MI_G] = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             [GPU_MI_T] = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            [GPU_MI_U] = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            [GPU_MI_C] = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         };
         
         if (gpu->flags & GPU_MEM_UNI)
@@ -269,7 +422,7 @@ internal int gpu_create_mem(void)
                         .queueFamilyIndex = gpu->q[GPU_QI_T].i,
                     },
                 };
-                for(u32 j=0; j < FRAME_WRAP; ++j) {
+                for(u32 j=0; j < GPU_MAX_FRAMES; ++j) {
                     for(u32 i=0; i < GPU_CMD_CNT; ++i) {
                         if (vk_create_cmdpool(&ci[i], &gpu->q[i].cmd[j].pool)) {
                             do {
@@ -288,7 +441,7 @@ internal int gpu_create_mem(void)
                     .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
                     .queueFamilyIndex = gpu->q[GPU_QI_G].i,
                 };
-                for(u32 j=0; j < FRAME_WRAP; ++j) {
+                for(u32 j=0; j < GPU_MAX_FRAMES; ++j) {
                     if (vk_create_cmdpool(&ci, &gpu->q[GPU_QI_G].cmd[j].pool)) {
                         while(--j < Max_u32) {
                             vk_destroy_cmdpool(gpu->q[GPU_QI_G].cmd[j].pool);
@@ -447,7 +600,7 @@ internal int gpu_create_mem(void)
         for(u32 i=0; i < cl_array_size(bm); ++i) {
             int x,y;
             bm[i] = stbtt_GetCodepointBitmap(&font, 0, stbtt_ScaleForPixelHeight(&font, FONT_HEIGHT),
-                                             cht[i], (int*)&bm_dim[i].w, (int*)&bm_dim[i].h, &x, &y);
+                                             (int)cht[i], (int*)&bm_dim[i].w, (int*)&bm_dim[i].h, &x, &y);
             
             g[i].x = (s16)x;
             g[i].y = (s16)y;
@@ -520,14 +673,22 @@ internal int gpu_create_mem(void)
     win_dim_cells.w = (u16)floorf((f32)win->dim.w / max_w);
     win_dim_cells.h = (u16)floorf((f32)win->dim.h / max_h);
     u32 cell_cnt = win_dim_cells.w * win_dim_cells.h;
-    u32 vert_sz = sizeof(*gpu->db.di) * cell_cnt * 2; // size for 2 frames
-    
-    if (vert_sz < bm_tot || (gpu->flags & GPU_MEM_UNI))
+    u16 grid_rows = (u16)(win_dim_cells.h + GPU_OVERSCAN * 2 + 1); // and the row a sub-cell shift reveals
+    u32 grid_cnt = win_dim_cells.w * grid_rows;
+    u32 grid_sz = sizeof(*gpu->grid.cell) * grid_cnt;
+    u32 frame_vert_sz = (u32)gpu_buf_align(sizeof(*gpu->db.di) * cell_cnt);
+    u32 frame_stage_sz = frame_vert_sz + (u32)gpu_buf_align(grid_sz);
+    u32 vert_sz = frame_vert_sz * gpu->frames; // a slice for each frame in flight
+    
+    // the whole grid is staged after a resize, as well as the draw buffer
+    if (frame_stage_sz * gpu->frames < bm_tot)
         bci[GPU_BI_T].size = bm_tot;
     else
-        bci[GPU_BI_T].size = vert_sz;
+        bci[GPU_BI_T].size = frame_stage_sz * gpu->frames;
     
     bci[GPU_BI_G].size = vert_sz;
+    bci[GPU_BI_U].size = sizeof(struct gpu_ubo);
+    bci[GPU_BI_C].size = grid_sz;
     
     VkBuffer buf[GPU_BUF_CNT];
     for(u32 i=0; i < GPU_BUF_CNT; ++i) {
@@ -548,6 +709,14 @@ internal int gpu_create_mem(void)
             .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
             .memoryTypeIndex = gpu->mem[GPU_MI_T].type,
         },
+        [GPU_BI_U] = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .memoryTypeIndex = gpu->mem[GPU_MI_U].type,
+        },
+        [GPU_BI_C] = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .memoryTypeIndex = gpu->mem[GPU_MI_C].type,
+        },
     };
     
     VkMemoryRequirements buf_mr[GPU_BUF_CNT];
@@ -568,6 +737,10 @@ internal int gpu_create_mem(void)
         log_error("Failed to map buffer memory %u (%s)", GPU_BI_T, gpu_mem_names[GPU_MI_T]);
         goto fail_free_buf_mem;
     }
+    if (vk_map_mem(mem[GPU_MI_U], 0, buf_mr[GPU_BI_U].size, &buf_map[GPU_BI_U])) {
+        log_error("Failed to map buffer memory %u (%s)", GPU_BI_U, gpu_mem_names[GPU_MI_U]);
+        goto fail_free_buf_mem;
+    }
     if (gpu->flags & GPU_MEM_UNI) {
         if (vk_map_mem(mem[GPU_MI_G], 0, buf_mr[GPU_BI_G].size, &buf_map[GPU_BI_G])) {
             log_error("Failed to map buffer memory %u (%s)", GPU_BI_G, gpu_mem_names[GPU_BI_G]);
@@ -582,12 +755,17 @@ internal int gpu_create_mem(void)
         }
     }
     
-    u64 db_mem_sz = gpu_dba_sz(cell_cnt);
+    u64 db_mem_sz = gpu_dba_sz(cell_cnt) * 2; // and the copy last presented
     void *db = palloc(MT, db_mem_sz);
     if (!db) {
         log_error("Failed to allocate memory for draw info array (%u bytes)", db_mem_sz);
         goto fail_free_buf_mem;
     }
+    void *grid = palloc(MT, grid_sz * 2);
+    if (!grid) {
+        log_error("Failed to allocate memory for cell grid (%u bytes)", grid_sz * 2);
+        goto fail_free_buf_mem;
+    }
     
     if (gpu->q[GPU_QI_G].i != gpu->q[GPU_QI_T].i) {
         enum {UT,TG,STAGE_CNT};
@@ -734,12 +912,23 @@ internal int gpu_create_mem(void)
     //     - destroy the old objects
     //     - assign the new objects
     
-    gpu->flags &= ~GPU_MEM_OFS;
-    
     if (gpu->db.di)
         pfree(MT, gpu->db.di);
     gpu->db.di = db;
+    gpu->db.prev = gpu->db.di + cell_cnt;
     gpu->db.used = 0;
+    gpu->db.prev_used = 0;
+    gpu->flags |= GPU_DMG;
+    
+    if (gpu->grid.cell)
+        pfree(MT, gpu->grid.cell);
+    gpu->grid.cell = grid;
+    gpu->grid.next = gpu->grid.cell + grid_cnt;
+    gpu->grid.cols = win_dim_cells.w;
+    gpu->grid.rows = grid_rows;
+    gpu->grid.used = 0;
+    gpu->grid.stale = true;
+    gpu_grid_clear();
     
     for(u32 i=0; i < GPU_MEM_CNT; ++i) {
         if (i == GPU_MI_R) continue; // do not free msaa image memory (it never needs to resize)
@@ -775,12 +964,18 @@ internal int gpu_create_mem(void)
         gpu->buf[i].handle = buf[i];
         gpu->buf[i].size = bci[i].size;
         gpu->buf[i].used = 0;
+        gpu->buf[i].slice = 0;
         gpu->buf[i].data = NULL;
     }
+    gpu->buf[GPU_BI_G].slice = frame_vert_sz;
+    gpu->buf[GPU_BI_T].slice = (bci[GPU_BI_T].size / gpu->frames) & ~(gpu->props.limits.optimalBufferCopyOffsetAlignment - 1);
     gpu->buf[GPU_BI_T].data = buf_map[GPU_BI_T];
+    gpu->buf[GPU_BI_U].data = buf_map[GPU_BI_U];
     if (gpu->flags & GPU_MEM_UNI)
         gpu->buf[GPU_BI_G].data = buf_map[GPU_BI_G];
     
+    gpu_write_ubo();
+    
 #if 0
     // NOTE(SollyCB): I would like to do this, but I cannot think of a way to signal
     // when this should happen that is clean enough to justify its minor benefit.
@@ -821,6 +1016,66 @@ internal int gpu_create_mem(void)
     return -1;
 }
 
+// A copy of the last presented image at the window size. Presented swapchain images
+// cannot be read, so a frame that scrolls starts from this instead.
+internal int gpu_create_last(void)
+{
+    if (gpu->db.last)
+        vk_destroy_img(gpu->db.last);
+    if (gpu->db.last_mem)
+        vk_free_mem(gpu->db.last_mem);
+    gpu->db.last = VK_NULL_HANDLE;
+    gpu->db.last_mem = VK_NULL_HANDLE;
+    gpu->db.last_ok = false;
+    
+    if (!gpu_can_reuse() || win->dim.w == 0 || win->dim.h == 0)
+        return 0;
+    
+    VkImageCreateInfo ci = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    ci.imageType = VK_IMAGE_TYPE_2D;
+    ci.format = gpu->sc.info.imageFormat;
+    ci.extent = (VkExtent3D) {.width = win->dim.w, .height = win->dim.h, .depth = 1};
+    ci.mipLevels = 1;
+    ci.arrayLayers = 1;
+    ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ci.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    
+    VkImage img;
+    if (vk_create_img(&ci, &img)) {
+        log_error("Failed to create last frame image");
+        return -1;
+    }
+    
+    VkMemoryRequirements mr;
+    vk_get_img_memreq(img, &mr);
+    
+    VkMemoryAllocateInfo ai = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    ai.allocationSize = mr.size;
+    ai.memoryTypeIndex = gpu_memtype_helper(mr.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    
+    VkDeviceMemory mem;
+    if (ai.memoryTypeIndex == Max_u32 || vk_alloc_mem(&ai, &mem)) {
+        log_error("Failed to allocate last frame memory, size %u", mr.size);
+        goto fail_dest_img;
+    }
+    if (vk_bind_img_mem(img, mem, 0)) {
+        log_error("Failed to bind last frame memory");
+        goto fail_free_mem;
+    }
+    
+    gpu->db.last = img;
+    gpu->db.last_mem = mem;
+    return 0;
+    
+    fail_free_mem:
+    vk_free_mem(mem);
+    
+    fail_dest_img:
+    vk_destroy_img(img);
+    return -1;
+}
+
 internal int gpu_create_sc(void)
 {
     char msg[128];
@@ -856,8 +1111,10 @@ internal int gpu_create_sc(void)
     }
     vk_destroy_sc_khr(gpu->sc.info.oldSwapchain);
     
+    // the implementation may make more images than were asked for
     VkImage imgs[SC_MAX_IMGS] = {};
-    if (vk_get_sc_imgs_khr(&gpu->sc.img_cnt, imgs)) {
+    u32 img_cnt = SC_MAX_IMGS;
+    if (vk_get_sc_imgs_khr(&img_cnt, imgs)) {
         strcpy(CLSTR(msg), STR("failed to get images"));
         goto fail_imgs;
     }
@@ -876,7 +1133,7 @@ internal int gpu_create_sc(void)
     
     VkImageView views[SC_MAX_IMGS] = {};
     u32 i;
-    for(i=0; i < gpu->sc.img_cnt; ++i) {
+    for(i=0; i < img_cnt; ++i) {
         ci.image = imgs[i];
         ci.format = sc_info.imageFormat;
         if (vk_create_imgv(&ci, &views[i])) {
@@ -889,12 +1146,14 @@ internal int gpu_create_sc(void)
     gpu->sc.info.imageExtent = sc_info.imageExtent;
     gpu->sc.i = 0;
     
-    for(i=0; i < gpu->sc.img_cnt; ++i) {
+    // the old swapchain may have had more images, the slots past the new count are emptied
+    for(i=0; i < SC_MAX_IMGS; ++i) {
         if (gpu->sc.views[i])
             vk_destroy_imgv(gpu->sc.views[i]);
         gpu->sc.views[i] = views[i];
         gpu->sc.imgs[i] = imgs[i];
     }
+    gpu->sc.img_cnt = img_cnt;
     
     return 0;
     
@@ -915,6 +1174,42 @@ internal int gpu_create_sc(void)
     return -1;
 }
 
+// Fifo waits for vblank with every queued image, so a key can sit behind a whole queue of
+// them. Mailbox replaces the queued image instead, and immediate does not queue at all
+// but can tear, so it is only taken without mailbox.
+internal void gpu_choose_present(void)
+{
+    VkSurfaceCapabilitiesKHR cap;
+    vk_get_phys_dev_surf_cap_khr(&cap);
+    
+    VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR; // always supported
+    if (gpu->sc.low_latency) {
+        VkPresentModeKHR modes[16];
+        u32 cnt = cl_array_size(modes);
+        vk_get_phys_dev_surf_pres_modes_khr(&cnt, modes);
+        for(u32 i=0; i < cnt; ++i) {
+            if (modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+                mode = VK_PRESENT_MODE_MAILBOX_KHR;
+            else if (modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR && mode == VK_PRESENT_MODE_FIFO_KHR)
+                mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+    }
+    
+    // an image for each frame in flight and one on screen, and mailbox a spare to replace
+    u32 img_cnt = gpu->frames + (mode == VK_PRESENT_MODE_MAILBOX_KHR ? 2 : 1);
+    if (img_cnt < cap.minImageCount)
+        img_cnt = cap.minImageCount;
+    if (img_cnt > cap.maxImageCount && cap.maxImageCount != 0)
+        img_cnt = cap.maxImageCount;
+    if (img_cnt > SC_MAX_IMGS)
+        img_cnt = SC_MAX_IMGS;
+    if (img_cnt < SC_MIN_IMGS)
+        img_cnt = SC_MIN_IMGS;
+    
+    gpu->sc.info.presentMode = mode;
+    gpu->sc.info.minImageCount = img_cnt;
+}
+
 internal int gpu_sc_next_img(void) {
     gpu->sc.i = (gpu->sc.i + 1) % gpu->sc.img_cnt;
     
@@ -958,16 +1253,23 @@ internal VkShaderModule gpu_create_shader(struct string spv)
 
 internal int gpu_create_dsl(void)
 {
-    local_persist VkDescriptorSetLayoutBinding b = {
-        .binding = SH_SI_SET,
-        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = CHT_SZ,
-        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    local_persist VkDescriptorSetLayoutBinding b[] = {
+        {
+            .binding = SH_SI_BND,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = CHT_SZ,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+        },{
+            .binding = SH_GM_BND,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        }
     };
     local_persist VkDescriptorSetLayoutCreateInfo ci = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = 1,
-        .pBindings = &b,
+        .bindingCount = cl_array_size(b),
+        .pBindings = b,
     };
     
     if (vk_create_dsl(&ci, &gpu->dsl))
@@ -978,10 +1280,17 @@ internal int gpu_create_dsl(void)
 
 internal int gpu_create_pll(void)
 {
+    VkPushConstantRange pc = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(struct gpu_pc),
+    };
     VkPipelineLayoutCreateInfo ci = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = 1,
         .pSetLayouts = &gpu->dsl,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pc,
     };
     
     if (vk_create_pll(&ci, &gpu->pll))
@@ -993,16 +1302,21 @@ internal int gpu_create_pll(void)
 internal int gpu_create_ds(void)
 {
     if (gpu->dp == VK_NULL_HANDLE) { // runs once per program
-        local_persist VkDescriptorPoolSize sz = {
-            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = CHT_SZ,
+        local_persist VkDescriptorPoolSize sz[] = {
+            {
+                .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = CHT_SZ,
+            },{
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = 1,
+            }
         };
         
         local_persist VkDescriptorPoolCreateInfo ci = {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
             .maxSets = 1,
-            .poolSizeCount = 1,
-            .pPoolSizes = &sz,
+            .poolSizeCount = cl_array_size(sz),
+            .pPoolSizes = sz,
         };
         if (vk_create_dp(&ci, &gpu->dp))
             return -1;
@@ -1032,15 +1346,31 @@ internal int gpu_create_ds(void)
         ii[i].imageView = gpu->glyph[i].view;
     }
     
-    VkWriteDescriptorSet w = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    w.dstSet = gpu->ds;
-    w.dstBinding = 0;
-    w.dstArrayElement = 0;
-    w.descriptorCount = CHT_SZ;
-    w.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    w.pImageInfo = ii;
+    VkDescriptorBufferInfo bi = {
+        .buffer = gpu->buf[GPU_BI_U].handle,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
     
-    vk_update_ds(1, &w);
+    VkWriteDescriptorSet w[2] = {
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
+        {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
+    };
+    w[0].dstSet = gpu->ds;
+    w[0].dstBinding = SH_SI_BND;
+    w[0].dstArrayElement = 0;
+    w[0].descriptorCount = CHT_SZ;
+    w[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    w[0].pImageInfo = ii;
+    
+    w[1].dstSet = gpu->ds;
+    w[1].dstBinding = SH_GM_BND;
+    w[1].dstArrayElement = 0;
+    w[1].descriptorCount = 1;
+    w[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    w[1].pBufferInfo = &bi;
+    
+    vk_update_ds(cl_array_size(w), w);
     
     return 0;
 }
@@ -1136,6 +1466,8 @@ internal int gpu_create_rp(void)
     };
     
     a[0].format = gpu->sc.info.imageFormat;
+    if (gpu_can_reuse())
+        a[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; // copied to db.last, then presented
 #endif
     
     VkRenderPassCreateInfo ci = {
@@ -1151,6 +1483,26 @@ internal int gpu_create_rp(void)
     if (vk_create_rp(&ci, &gpu->rp))
         return -1;
     
+#if !MSAA
+    // The same pass drawn over the last frame, which is copied in first, so it loads the
+    // image rather than clearing it.
+    if (gpu_can_reuse()) {
+        VkAttachmentDescription la = a[0];
+        la.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        la.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        
+        VkSubpassDependency ld = d;
+        ld.srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        ld.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+        ld.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+        
+        ci.pAttachments = &la;
+        ci.pDependencies = &ld;
+        if (vk_create_rp(&ci, &gpu->rp_load))
+            return -1;
+    }
+#endif
+    
     return 0;
 }
 
@@ -1202,20 +1554,10 @@ internal int gpu_create_pl(void)
     };
     
     local_persist VkVertexInputAttributeDescription vi_a[] = {
-        [SH_PD_LOC] = {
-            .location = SH_PD_LOC,
-            .format = CELL_PD_FMT,
-            .offset = offsetof(typeof(*gpu->db.di), pd),
-        },
-        [SH_FG_LOC] = {
-            .location = SH_FG_LOC,
-            .format = CELL_FG_FMT,
-            .offset = offsetof(typeof(*gpu->db.di), fg),
-        },
-        [SH_BG_LOC] = {
-            .location = SH_BG_LOC,
-            .format = CELL_BG_FMT,
-            .offset = offsetof(typeof(*gpu->db.di), bg),
+        [SH_CELL_LOC] = {
+            .location = SH_CELL_LOC,
+            .format = CELL_DI_FMT,
+            .offset = offsetof(typeof(*gpu->db.di), col),
         },
     };
     
@@ -1330,16 +1672,6 @@ internal int gpu_create_pl(void)
     return 0;
 }
 
-internal struct rect_u16 gpu_normalize_px_rect(struct rect_u16 rect)
-{
-    struct rect_u16 r;
-    r.ofs.x = (u16)floorf((f32)rect.ofs.x * win->rdim.w * 65535);
-    r.ofs.y = (u16)floorf((f32)rect.ofs.y * win->rdim.h * 65535);
-    r.ext.w = (u16)ceilf((f32)rect.ext.w * win->rdim.w * 65535);
-    r.ext.h = (u16)ceilf((f32)rect.ext.h * win->rdim.h * 65535);
-    return r;
-}
-
 internal struct rect_u16 gpu_px_to_cell_rect(struct rect_u16 rect)
 {
     struct rect_u16 r;
@@ -1560,8 +1892,6 @@ def_create_gpu(create_gpu)
             return -1;
         }
         
-        gpu->sc.img_cnt = cap.minImageCount < SC_MIN_IMGS ? SC_MIN_IMGS : cap.minImageCount;
-        
         u32 fmt_cnt = 1;
         VkSurfaceFormatKHR fmt;
         vk_get_phys_dev_surf_fmts_khr(&fmt_cnt, &fmt);
@@ -1572,15 +1902,22 @@ def_create_gpu(create_gpu)
         gpu->sc.info.imageExtent = cap.currentExtent;
         gpu->sc.info.imageFormat = fmt.format;
         gpu->sc.info.imageColorSpace = fmt.colorSpace;
-        gpu->sc.info.minImageCount = gpu->sc.img_cnt;
         gpu->sc.info.imageArrayLayers = 1;
         gpu->sc.info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        
+        // frames are copied to and from db.last to be reused when scrolling
+        VkImageUsageFlags cpy = VK_IMAGE_USAGE_TRANSFER_SRC_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if (!MSAA && (cap.supportedUsageFlags & cpy) == cpy)
+            gpu->sc.info.imageUsage |= cpy;
         gpu->sc.info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         gpu->sc.info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         gpu->sc.info.clipped = VK_TRUE;
         gpu->sc.info.queueFamilyIndexCount = 1;
         gpu->sc.info.pQueueFamilyIndices = &gpu->q[GPU_QI_P].i;
-        gpu->sc.info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        
+        gpu->frames = GPU_DEF_FRAMES;
+        gpu->sc.low_latency = GPU_DEF_LOW_LATENCY;
+        gpu_choose_present();
         
         for(u32 i=0; i < ctz(VK_SAMPLE_COUNT_64_BIT); ++i) {
             if (gpu->props.limits.framebufferColorSampleCounts & (1<<i))
@@ -1592,6 +1929,7 @@ def_create_gpu(create_gpu)
     }
     
     gpu_create_mem();
+    gpu_create_last();
     gpu_create_sh();
     gpu_create_dsl();
     gpu_create_pll();
@@ -1712,6 +2050,8 @@ def_gpu_handle_win_resize(gpu_handle_win_resize)
         log_error("Failed to create memory objects on window resize");
         return -1;
     }
+    if (gpu_create_last())
+        log_error("Failed to create last frame image on window resize, every frame will be drawn whole");
     if (gpu_create_ds()) {
         log_error("Failed to allocate descriptor sets after window resize");
         return -1;
@@ -1720,10 +2060,330 @@ def_gpu_handle_win_resize(gpu_handle_win_resize)
     return 0;
 }
 
+internal struct gpu_pc gpu_make_pc(void)
+{
+    struct gpu_pc pc;
+    pc.rdim = win->rdim;
+    pc.org[0] = gpu->db.org.x;
+    pc.org[1] = gpu->db.org.y;
+    pc.cell[0] = gpu->cell.dim_px.w;
+    pc.cell[1] = gpu->cell.dim_px.h + GPU_ROW_PAD;
+    pc.shift[0] = gpu->db.shift[0];
+    pc.shift[1] = gpu->db.shift[1];
+    pc.top = gpu->db.top;
+    pc.rows = gpu->grid.rows;
+    return pc;
+}
+
+// Whether this frame differs from the last one presented.
+internal bool gpu_db_damaged(void)
+{
+    if ((gpu->flags & GPU_DMG) || (win->flags & WIN_EXP))
+        return true;
+    struct gpu_pc pc = gpu_make_pc();
+    if (memcmp(&pc, &gpu->db.prev_pc, sizeof(pc)))
+        return true;
+    if (gpu->db.used != gpu->db.prev_used ||
+        memcmp(gpu->db.di, gpu->db.prev, sizeof(*gpu->db.di) * gpu->db.used))
+        return true;
+    return memcmp(gpu->grid.next, gpu->grid.cell, sizeof(*gpu->grid.cell) * gpu->grid.cols * gpu->grid.rows) != 0;
+}
+
+// Add the band y0 to y1 of the clip to a list sorted by y. Bands it covers or touches
+// are merged into it. False if the list is full.
+internal bool gpu_strip_add(VkRect2D *strip, u32 *cnt, VkRect2D clip, s32 y0, s32 y1)
+{
+    if (y0 < clip.offset.y)
+        y0 = clip.offset.y;
+    if (y1 > clip.offset.y + (s32)clip.extent.height)
+        y1 = clip.offset.y + (s32)clip.extent.height;
+    if (y0 >= y1)
+        return true;
+    
+    while(*cnt) {
+        VkRect2D *l = &strip[*cnt-1];
+        s32 end = l->offset.y + (s32)l->extent.height;
+        if (end < y0)
+            break;
+        if (l->offset.y < y0)
+            y0 = l->offset.y;
+        if (end > y1)
+            y1 = end;
+        *cnt -= 1;
+    }
+    if (*cnt == GPU_MAX_STRIPS)
+        return false;
+    
+    strip[*cnt] = clip;
+    strip[*cnt].offset.y = y0;
+    strip[*cnt].extent.height = (u32)(y1 - y0);
+    *cnt += 1;
+    return true;
+}
+
+// Find what of the last presented image this frame can keep, before the grid is synced.
+// The view is the last one moved dy pixels down, apart from the returned number of
+// bands which have to be redrawn: the rows that changed, moved around the ring or hold
+// a changed overlay, and the rows the move exposes. Returns Max_u32 if the whole view
+// has to be drawn.
+internal u32 gpu_db_strips(struct gpu_pc *pc, VkRect2D clip, s32 *dy, VkRect2D *strip)
+{
+    struct gpu_pc *prev = &gpu->db.prev_pc;
+    struct gpu_grid *grid = &gpu->grid;
+    *dy = 0;
+    
+    if (!gpu->db.last_ok || grid->stale || (gpu->flags & GPU_DMG) || (win->flags & WIN_EXP))
+        return Max_u32;
+    
+    // only a vertical scroll can be moved
+    struct gpu_pc same = *prev;
+    same.shift[1] = pc->shift[1];
+    same.top = pc->top;
+    if (memcmp(&same, pc, sizeof(same)))
+        return Max_u32;
+    
+    s32 rows = pc->rows;
+    s32 h = pc->cell[1];
+    s32 d = (pc->top - prev->top + rows) % rows; // rows scrolled down
+    if (d > rows / 2)
+        d -= rows;
+    *dy = pc->shift[1] - prev->shift[1] - d * h;
+    if (*dy <= -(s32)clip.extent.height || *dy >= (s32)clip.extent.height)
+        return Max_u32;
+    
+    u8 *ovl = NULL;
+    if (gpu->db.used != gpu->db.prev_used ||
+        memcmp(gpu->db.di, gpu->db.prev, sizeof(*gpu->db.di) * gpu->db.used))
+    {
+        ovl = salloc(MT, rows);
+        memset(ovl, 0, rows);
+        for(u32 i=0; i < gpu->db.used; ++i)
+            ovl[gpu->db.di[i].row % rows] = 1;
+        for(u32 i=0; i < gpu->db.prev_used; ++i)
+            ovl[gpu->db.prev[i].row % rows] = 1;
+    }
+    
+    u32 cnt = 0;
+    if (*dy > 0 && !gpu_strip_add(strip, &cnt, clip, clip.offset.y, clip.offset.y + *dy))
+        return Max_u32;
+    
+    u64 row_sz = sizeof(*grid->cell) * grid->cols;
+    for(s32 r=0; r < rows; ++r) {
+        s32 s = (pc->top + r) % rows;
+        if (r - (s - prev->top + rows) % rows == -d &&
+            (ovl == NULL || ovl[s] == 0) &&
+            memcmp(grid->next + s * grid->cols, grid->cell + s * grid->cols, row_sz) == 0)
+            continue;
+        s32 base = pc->org[1] + pc->shift[1] + h * (r + 1);
+        if (!gpu_strip_add(strip, &cnt, clip, base + gpu->cell.ink[0], base + gpu->cell.ink[1]))
+            return Max_u32;
+    }
+    
+    s32 end = clip.offset.y + (s32)clip.extent.height;
+    if (*dy < 0 && !gpu_strip_add(strip, &cnt, clip, end + *dy, end))
+        return Max_u32;
+    
+    // past half the view, one draw is cheaper than the strips
+    u32 px = 0;
+    for(u32 i=0; i < cnt; ++i)
+        px += strip[i].extent.height;
+    if (px > clip.extent.height / 2)
+        return Max_u32;
+    
+    return cnt;
+}
+
+// Copy the last frame into the swapchain image, with the view moved dy pixels down.
+// The band the move exposes is left undefined, for the strips to draw.
+internal void gpu_last_to_swap(VkCommandBuffer cmd, VkImage swap, VkRect2D clip, s32 dy)
+{
+    enum {LAST,SWAP};
+    VkImageMemoryBarrier2 b[] = {
+        [LAST] = { // written by the frame before
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = gpu->db.last,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+        },
+        [SWAP] = { // the acquire semaphore is waited on at the transfer stage
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = swap,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+        },
+    };
+    VkDependencyInfo dep = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dep.imageMemoryBarrierCount = cl_array_size(b);
+    dep.pImageMemoryBarriers = b;
+    vk_cmd_pl_barr(cmd, &dep);
+    
+    VkImageCopy r[3];
+    u32 cnt = 0;
+    VkImageCopy e = {
+        .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,.layerCount = 1},
+        .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,.layerCount = 1},
+        .extent = {.depth = 1},
+    };
+    
+    // the margins above and left of the view never move
+    if (clip.offset.y > 0) {
+        r[cnt] = e;
+        r[cnt].extent.width = win->dim.w;
+        r[cnt].extent.height = clip.offset.y;
+        cnt += 1;
+    }
+    if (clip.offset.x > 0 && clip.extent.height) {
+        r[cnt] = e;
+        r[cnt].srcOffset.y = r[cnt].dstOffset.y = clip.offset.y;
+        r[cnt].extent.width = clip.offset.x;
+        r[cnt].extent.height = clip.extent.height;
+        cnt += 1;
+    }
+    
+    s32 y0 = clip.offset.y - (dy < 0 ? dy : 0);
+    s32 y1 = clip.offset.y + (s32)clip.extent.height - (dy > 0 ? dy : 0);
+    if (clip.extent.width && y0 < y1) {
+        r[cnt] = e;
+        r[cnt].srcOffset.x = r[cnt].dstOffset.x = clip.offset.x;
+        r[cnt].srcOffset.y = y0;
+        r[cnt].dstOffset.y = y0 + dy;
+        r[cnt].extent.width = clip.extent.width;
+        r[cnt].extent.height = (u32)(y1 - y0);
+        cnt += 1;
+    }
+    
+    if (cnt)
+        vk_cmd_imgcpy(cmd, cnt, r, gpu->db.last, VK_IMAGE_LAYOUT_GENERAL, swap, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+
+// Keep what this frame drew in db.last for the next one, the whole image or only the
+// strips, then hand the swapchain image to the present. Without last_ok db.last has
+// never been written, or holds a frame that was not submitted.
+internal void gpu_swap_to_last(VkCommandBuffer cmd, VkImage swap, VkRect2D *strip, u32 strip_cnt, bool last_ok)
+{
+    enum {LAST,SWAP};
+    VkImageMemoryBarrier2 b[] = {
+        [LAST] = { // read at the start of this frame, and written by the frame before
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout = last_ok ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = gpu->db.last,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+        },
+        [SWAP] = { // left in transfer src by the render pass
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = swap,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+        },
+    };
+    VkDependencyInfo dep = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dep.imageMemoryBarrierCount = cl_array_size(b);
+    dep.pImageMemoryBarriers = b;
+    
+    if (gpu->db.last) {
+        vk_cmd_pl_barr(cmd, &dep);
+        
+        VkImageCopy r[GPU_MAX_STRIPS];
+        VkImageCopy e = {
+            .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,.layerCount = 1},
+            .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,.layerCount = 1},
+            .extent = {.width = win->dim.w, .height = win->dim.h, .depth = 1},
+        };
+        u32 cnt = 1;
+        r[0] = e;
+        if (strip_cnt != Max_u32) {
+            for(u32 i=0; i < strip_cnt; ++i) {
+                r[i] = e;
+                r[i].srcOffset.x = r[i].dstOffset.x = strip[i].offset.x;
+                r[i].srcOffset.y = r[i].dstOffset.y = strip[i].offset.y;
+                r[i].extent.width = strip[i].extent.width;
+                r[i].extent.height = strip[i].extent.height;
+            }
+            cnt = strip_cnt;
+        }
+        if (cnt)
+            vk_cmd_imgcpy(cmd, cnt, r, swap, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, gpu->db.last, VK_IMAGE_LAYOUT_GENERAL);
+    }
+    
+    b[SWAP].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT|VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    b[SWAP].dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    b[SWAP].dstAccessMask = VK_ACCESS_2_NONE;
+    b[SWAP].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    dep.imageMemoryBarrierCount = 1;
+    dep.pImageMemoryBarriers = &b[SWAP];
+    vk_cmd_pl_barr(cmd, &dep);
+}
+
+// The grid, empty cells have no extent so make no fragments, then the draw buffer on top.
+internal void gpu_db_draw(VkCommandBuffer cmd, u64 ofs)
+{
+    u64 grid_ofs = 0;
+    vk_cmd_bind_vb(cmd, 0, 1, &gpu->buf[GPU_BI_C].handle, &grid_ofs);
+    vk_cmd_draw(cmd, 6, gpu->grid.cols * gpu->grid.rows);
+    if (gpu->db.used) {
+        vk_cmd_bind_vb(cmd, 0, 1, &gpu->buf[GPU_BI_G].handle, &ofs);
+        vk_cmd_draw(cmd, 6, gpu->db.used);
+    }
+}
+
+def_gpu_set_latency(gpu_set_latency)
+{
+    if (frames < 1)
+        frames = 1;
+    if (frames > GPU_MAX_FRAMES)
+        frames = GPU_MAX_FRAMES;
+    
+    // the resize waits for the frames in flight before the buffer slices are recut
+    gpu->sc.low_latency = low;
+    gpu->frames = frames;
+    frm_i = 0;
+    gpu_choose_present();
+    
+    if (gpu_handle_win_resize()) {
+        log_error("Failed to rebuild swapchain for %u frames in flight", frames);
+        return -1;
+    }
+    println("Present mode %u, %u frames in flight, %u swapchain images",
+            gpu->sc.info.presentMode, gpu->frames, gpu->sc.img_cnt);
+    return 0;
+}
+
 def_gpu_update(gpu_update)
 {
-    if (gpu->db.used == 0)
+    // nothing to present to while minimized, and nothing new to present without damage
+    if ((win->flags & WIN_MIN) || !gpu_db_damaged()) {
+        gpu_grid_clear();
+        gpu->db.used = 0;
+        gpu->db.in_cnt = 0; // keys that changed nothing never reach the screen
         return 0;
+    }
     
     gpu_inc_frame();
     gpu_db_await_fence(frm_i);
@@ -1741,15 +2401,10 @@ def_gpu_update(gpu_update)
     }
     
     for(u32 i=0; i < GPU_BUF_CNT; ++i) {
-        if ((gpu->flags & GPU_MEM_OFS) == false) {
-            gpu->buf[i].used = 0;
-            gpu->buf[i].size >>= 1;
-        } else {
-            gpu->buf[i].used = gpu->buf[i].size;
-            gpu->buf[i].size <<= 1;
-        }
+        if (gpu->buf[i].slice == 0) continue; // not split between frames
+        gpu->buf[i].used = gpu->buf[i].slice * frm_i;
+        gpu->buf[i].size = gpu->buf[i].used + gpu->buf[i].slice;
     }
-    gpu->flags ^= GPU_MEM_OFS;
     
     gpu_db_flush();
     
@@ -1761,17 +2416,61 @@ def_gpu_db_add(gpu_db_add)
     if (gpu->db.used == gpu->cell.cnt)
         return -1;
     
-    struct rect_u16 win_rect = {.ext = win->dim};
-    rect_clamp(rect, win_rect);
-    
-    gpu->db.di[gpu->db.used].pd = gpu_normalize_px_rect(rect);
-    gpu->db.di[gpu->db.used].bg = bg;
-    gpu->db.di[gpu->db.used].fg = fg;
+    struct draw_info *di = &gpu->db.di[gpu->db.used];
+    di->col = col;
+    di->row = row;
+    di->glyph = glyph;
+    di->pal = pal;
     gpu->db.used += 1;
     
     return 0;
 }
 
+def_gpu_db_add_input(gpu_db_add_input)
+{
+    if (gpu->db.in_cnt < cl_array_size(gpu->db.in_tick))
+        gpu->db.in_tick[gpu->db.in_cnt++] = tick;
+}
+
+def_gpu_grid_set(gpu_grid_set)
+{
+    if (col >= gpu->grid.cols || row >= gpu->grid.rows)
+        return -1;
+    
+    struct draw_info *di = &gpu->grid.next[row * gpu->grid.cols + col];
+    di->col = col;
+    di->row = row;
+    di->glyph = glyph;
+    di->pal = pal;
+    gpu->grid.used += 1;
+    
+    return 0;
+}
+
+def_gpu_grid_set_span(gpu_grid_set_span)
+{
+    // clipped once for the whole span, cells past the edge of the grid are dropped
+    if (col >= gpu->grid.cols || row >= gpu->grid.rows)
+        return 0;
+    if (cnt > (u32)(gpu->grid.cols - col))
+        cnt = gpu->grid.cols - col;
+    
+    struct draw_info *di = gpu->grid.next + row * gpu->grid.cols + col;
+    u32 n = 0;
+    for(u32 i=0; i < cnt; ++i) {
+        if (g[i] == GPU_GLYPH_NONE)
+            continue;
+        di[i].col = (u16)(col + i);
+        di[i].row = row;
+        di[i].glyph = g[i];
+        di[i].pal = pal;
+        n += 1;
+    }
+    gpu->grid.used += n;
+    
+    return 0;
+}
+
 def_gpu_db_flush(gpu_db_flush)
 {
     char msg[127];
@@ -1875,6 +2574,28 @@ def_gpu_db_flush(gpu_db_flush)
         vk_end_cmd(cmd[GPU_CI_T]);
     }
     
+    // overscan rows above the view are drawn, but only the view is kept
+    VkRect2D clip;
+    clip.offset.x = gpu->db.org.x < win->dim.w ? gpu->db.org.x : win->dim.w;
+    clip.offset.y = gpu->db.org.y < win->dim.h ? gpu->db.org.y : win->dim.h;
+    clip.extent.width = win->dim.w - clip.offset.x;
+    clip.extent.height = win->dim.h - clip.offset.y;
+    
+    // a frame close enough to the last one is drawn over a copy of it
+    struct gpu_pc pc = gpu_make_pc();
+    VkRect2D strip[GPU_MAX_STRIPS];
+    s32 dy;
+    u32 strip_cnt = gpu_db_strips(&pc, clip, &dy, strip);
+    bool reuse = strip_cnt != Max_u32;
+    bool last_ok = gpu->db.last_ok;
+    gpu->db.last_ok = false; // until this frame is submitted
+    VkImage swap = gpu->sc.imgs[gpu->sc.img_i[gpu->sc.i]];
+    
+    // the grid goes through the graphics queue whatever the memory arch, as it has to be
+    // ordered against the draws of earlier frames
+    if (gpu_grid_sync(cmd[GPU_CI_G]))
+        log_error("Failed to upload cell grid, drawing the last one uploaded");
+    
     VkRect2D ra;
     ra.offset.x = 0;
     ra.offset.y = 0;
@@ -1916,7 +2637,7 @@ def_gpu_db_flush(gpu_db_flush)
     VkClearValue cv = {{{1.0f,1.0f,1.0f,1.0f}}};
     
     VkRenderPassBeginInfo rbi = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-    rbi.renderPass = gpu->rp;
+    rbi.renderPass = reuse ? gpu->rp_load : gpu->rp;
     rbi.framebuffer = gpu->fb[frm_i];
     rbi.renderArea = ra;
     rbi.clearValueCount = 1;
@@ -1936,16 +2657,45 @@ def_gpu_db_flush(gpu_db_flush)
     vp.maxDepth = 1.0f;
     
     VkCommandBuffer gcmd = cmd[GPU_CI_G];
+    if (reuse)
+        gpu_last_to_swap(gcmd, swap, clip, dy);
+    
     vk_cmd_begin_rp(gcmd, &rbi, &sbi);
     vk_cmd_bind_pl(gcmd, VK_PIPELINE_BIND_POINT_GRAPHICS, gpu->pl);
     vk_cmd_set_viewport(gcmd, 0, 1, &vp);
-    vk_cmd_set_scissor(gcmd, 0, 1, &ra);
     vk_cmd_bind_ds(gcmd, VK_PIPELINE_BIND_POINT_GRAPHICS, gpu->pll, 0, 1, &gpu->ds);
-    vk_cmd_bind_vb(gcmd, 0, 1, &gpu->buf[GPU_BI_G].handle, &ofs);
-    vk_cmd_draw(gcmd, 6, gpu->db.used);
+    vk_cmd_push_const(gcmd, gpu->pll, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pc), &pc);
+    gpu->db.prev_pc = pc;
+    
+    if (reuse) {
+        // each strip is cleared and everything is drawn clipped to it, which leaves the
+        // same pixels a whole frame would
+        VkClearAttachment ca = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .clearValue = cv};
+        VkClearRect cr[GPU_MAX_STRIPS];
+        for(u32 i=0; i < strip_cnt; ++i)
+            cr[i] = (VkClearRect) {.rect = strip[i], .layerCount = 1};
+        if (strip_cnt)
+            vk_cmd_clear_att(gcmd, 1, &ca, strip_cnt, cr);
+        for(u32 i=0; i < strip_cnt; ++i) {
+            vk_cmd_set_scissor(gcmd, 0, 1, &strip[i]);
+            gpu_db_draw(gcmd, ofs);
+        }
+    } else {
+        vk_cmd_set_scissor(gcmd, 0, 1, &clip);
+        gpu_db_draw(gcmd, ofs);
+    }
     vk_cmd_end_rp(gcmd);
+    
+    // after a scroll the whole view has moved, so all of it is copied back
+    if (gpu_can_reuse())
+        gpu_swap_to_last(gcmd, swap, strip, reuse && dy == 0 ? strip_cnt : Max_u32, last_ok);
     vk_end_cmd(gcmd);
     
+    // the copy from the last frame writes the swapchain image before the render pass
+    VkPipelineStageFlags sc_stg = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    if (reuse)
+        sc_stg |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    
     if ((gpu->flags & GPU_MEM_UNI) == false && gpu->q[GPU_QI_T].i != gpu->q[GPU_QI_G].i) {
         enum {WTR,WSC};
         VkSemaphore w_sem[] = {
@@ -1954,7 +2704,7 @@ def_gpu_db_flush(gpu_db_flush)
         };
         VkPipelineStageFlags w_stg[] = {
             [WTR] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-            [WSC] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            [WSC] = sc_stg,
         };
         VkSubmitInfo gsi = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
         gsi.waitSemaphoreCount = cl_array_size(w_sem);
@@ -1985,7 +2735,7 @@ def_gpu_db_flush(gpu_db_flush)
             [WSC] = gpu->sc.sem[gpu->sc.i],
         };
         VkPipelineStageFlags w_stg[] = {
-            [WSC] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            [WSC] = sc_stg,
         };
         
         VkSubmitInfo gsi = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
@@ -2004,7 +2754,11 @@ def_gpu_db_flush(gpu_db_flush)
     }
     
     gpu->db.in_use_fences |= 1 << frm_i;
+    gpu->db.last_ok = gpu->db.last != VK_NULL_HANDLE;
+    memcpy(gpu->db.prev, gpu->db.di, sizeof(*gpu->db.di) * gpu->db.used);
+    gpu->db.prev_used = gpu->db.used;
     gpu->db.used = 0;
+    gpu->flags &= ~GPU_DMG;
     
     VkResult r;
     VkPresentInfoKHR pi = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
@@ -2018,9 +2772,14 @@ def_gpu_db_flush(gpu_db_flush)
     if (vk_qpres(&pi)) {
         println("QueuePresent was not VK_SUCCESS, requesting window resize");
         win->flags |= WIN_RSZ;
+        gpu->db.in_cnt = 0;
         return -1;
     }
     
+    for(u32 i=0; i < gpu->db.in_cnt; ++i)
+        prg_lat_add(gpu->db.in_tick[i]);
+    gpu->db.in_cnt = 0;
+    
     return 0;
     
     bufcpy_fail:
@@ -2037,7 +2796,7 @@ def_gpu_check_leaks(gpu_check_leaks)
     
     u32 tmp = frm_i;
     frm_i = 0;
-    for(u32 j=0; j < FRAME_WRAP; ++j) {
+    for(u32 j=0; j < GPU_MAX_FRAMES; ++j) {
         for(u32 i=0; i < GPU_CMD_CNT; ++i) {
             gpu_dealloc_cmds(i);
             vk_destroy_cmdpool(gpu_cmd(i).pool);
@@ -2062,6 +2821,8 @@ def_gpu_check_leaks(gpu_check_leaks)
     vk_destroy_pll(gpu->pll);
     vk_destroy_pl(gpu->pl);
     vk_destroy_rp(gpu->rp);
+    if (gpu->rp_load)
+        vk_destroy_rp(gpu->rp_load);
     for(u32 i=0; i < cl_array_size(gpu->fb); ++i) {
         if (gpu->fb[i])
             vk_destroy_fb(gpu->fb[i]);
@@ -2076,8 +2837,10 @@ def_gpu_check_leaks(gpu_check_leaks)
     vk_destroy_dp(gpu->dp);
     vk_destroy_sampler(gpu->sampler);
     
-    for(u32 i=0; i < gpu->sc.img_cnt; ++i)
-        vk_destroy_imgv(gpu->sc.views[i]);
+    for(u32 i=0; i < cl_array_size(gpu->sc.views); ++i) {
+        if (gpu->sc.views[i])
+            vk_destroy_imgv(gpu->sc.views[i]);
+    }
     for(u32 i=0; i < cl_array_size(gpu->sc.sem); ++i)
         vk_destroy_sem(gpu->sc.sem[i]);
     vk_destroy_sc_khr(gpu->sc.info.oldSwapchain);
@@ -2086,6 +2849,8 @@ def_gpu_check_leaks(gpu_check_leaks)
         vk_destroy_img(gpu->db.img[i]);
         vk_destroy_imgv(gpu->db.view[i]);
     }
+    vk_destroy_img(gpu->db.last);
+    vk_free_mem(gpu->db.last_mem);
     
     vkDestroyDevice(gpu->dev, NULL);
 }
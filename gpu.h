@@ -6,11 +6,20 @@
 #include "shader.h"
 #include "chars.h"
 
-#define SC_MAX_IMGS 4 /* Arbitrarily small size that I doubt will be exceeded */
+#define SC_MAX_IMGS 6 /* Arbitrarily small size that I doubt will be exceeded */
 #define SC_MIN_IMGS 2
-#define FRAME_WRAP 2
-
-extern u32 frm_i; // frame index, is either 0 or 1
+#define GPU_MAX_FRAMES 3 /* frames in flight, gpu.frames is set at runtime up to this */
+#define GPU_DEF_FRAMES 2
+#define GPU_DEF_LOW_LATENCY true /* prefer mailbox or immediate presents to fifo */
+#define GPU_GLYPH_NONE 0xff /* empty cell in a span, CHT_SZ stays below it */
+#define GPU_GLYPH_BLOCK 0xfe /* solid cell in the bg colour */
+#define GPU_BLOCK_PAD 1 /* the block reaches this many pixels above its cell, for cursors */
+#define GPU_ROW_PAD 0 /* padding between rows in pixels */
+#define GPU_INPUT_CNT 64 /* keystrokes a frame carries to its present */
+#define GPU_OVERSCAN 4 /* grid rows past each edge of the window, so short scrolls reuse rows */
+#define GPU_MAX_STRIPS 8 /* bands a frame redraws over the last one before it redraws everything */
+
+extern u32 frm_i; // frame index, below gpu.frames
 
 enum {
     DB_SI_T, // transfer complete
@@ -24,7 +33,7 @@ enum {
 enum gpu_flags {
     GPU_MEM_INI = 0x01, // mem.type is valid
     GPU_MEM_UNI = 0x02, // mem arch is unified
-    GPU_MEM_OFS = 0x04, // buffers use the top half this frame
+    GPU_DMG = 0x04, // the presented image is out of date
     
     GPU_MEM_BITS = GPU_MEM_INI|GPU_MEM_UNI,
 };
@@ -33,6 +42,8 @@ enum gpu_mem_indices {
     GPU_MI_G,
     GPU_MI_T,
     GPU_MI_I,
+    GPU_MI_U, // glyph metrics and palette
+    GPU_MI_C, // cell grid
     GPU_MI_R, // msaa render target
     GPU_MEM_CNT,
 };
@@ -40,6 +51,8 @@ enum gpu_mem_indices {
 enum gpu_buf_indices {
     GPU_BI_G,
     GPU_BI_T,
+    GPU_BI_U,
+    GPU_BI_C,
     GPU_BUF_CNT,
 };
 
@@ -57,6 +70,28 @@ enum gpu_cmdq_indices {
     GPU_CMD_CNT
 };
 
+// Palette entries, SH_PAL_CNT in shader.h.
+enum gpu_pal {
+    GPU_PAL_TEXT,
+    GPU_PAL_CSR,
+};
+
+// Uniform read by the vertex shader, gm_t in shader.h.
+struct gpu_ubo {
+    s32 glyph[SH_GM_CNT][4]; // x,y,w,h in pixels from the baseline at the bottom of a cell
+    f32 pal[SH_PAL_CNT][2][4]; // fg and bg
+};
+
+// Push constants, pc_t in shader.h.
+struct gpu_pc {
+    struct extent_f32 rdim;
+    s32 org[2];
+    s32 cell[2];
+    s32 shift[2];
+    s32 top;
+    s32 rows;
+};
+
 struct gpu {
     VkInstance inst;
     VkSurfaceKHR surf;
@@ -67,6 +102,7 @@ struct gpu {
     
     u32 flags;
     u32 q_cnt;
+    u32 frames; // frames in flight, 1 to GPU_MAX_FRAMES
     
     struct {
         VkQueue handle;
@@ -75,7 +111,7 @@ struct gpu {
             u32 buf_cnt;
             VkCommandPool pool;
             VkCommandBuffer bufs[GPU_MAX_CMDS];
-        } cmd[FRAME_WRAP];
+        } cmd[GPU_MAX_FRAMES];
     } q[GPU_Q_CNT];
     
     struct {
@@ -86,8 +122,9 @@ struct gpu {
     struct {
         VkBuffer handle;
         void *data;
-        u64 size;
+        u64 size; // the end of this frame's slice, if split
         u64 used;
+        u64 slice; // bytes each frame in flight owns, 0 if not split between frames
     } buf[GPU_BUF_CNT];
     
     struct gpu_glyph {
@@ -102,6 +139,7 @@ struct gpu {
         struct extent_f32 rdim_px; // reciprocals
         struct extent_f32 rwin_dim_cells;
         s32 y_ofs; // default cell px shift
+        s32 ink[2]; // top and bottom of any glyph's pixels, from the bottom of its cell
         u32 cnt;
     } cell;
     
@@ -113,6 +151,7 @@ struct gpu {
         VkSemaphore sem[SC_MAX_IMGS];
         u32 img_i[SC_MAX_IMGS];
         u32 img_cnt,i;
+        bool low_latency; // see GPU_DEF_LOW_LATENCY
     } sc;
     
     struct {
@@ -123,7 +162,8 @@ struct gpu {
     VkPipelineLayout pll;
     VkPipeline pl;
     VkRenderPass rp;
-    VkFramebuffer fb[FRAME_WRAP];
+    VkRenderPass rp_load; // keeps the image, for frames drawn over the last one
+    VkFramebuffer fb[GPU_MAX_FRAMES];
     
     VkDescriptorSetLayout dsl;
     VkDescriptorPool dp;
@@ -133,17 +173,41 @@ struct gpu {
     
     struct draw_buffer { // size == gpu.cell.cnt
         VkSemaphore sem[DB_SEM_CNT];
-        VkFence fence[FRAME_WRAP];
-        VkImage img[FRAME_WRAP]; // msaa render target
-        VkImageView view[FRAME_WRAP];
-        struct draw_info {
-            struct rect_u16 pd;
-            struct rgba fg,bg;
+        VkFence fence[GPU_MAX_FRAMES];
+        VkImage img[GPU_MAX_FRAMES]; // msaa render target
+        VkImageView view[GPU_MAX_FRAMES];
+        struct draw_info { // one cell, placed by the vertex shader
+            u16 col,row;
+            u16 glyph; // or GPU_GLYPH_BLOCK
+            u16 pal; // enum gpu_pal
         } *di;
+        struct draw_info *prev; // the draw infos last presented, to find damage
         u32 used; // number of occupied draw infos
+        u32 prev_used;
+        u64 in_tick[GPU_INPUT_CNT]; // arrival of the keys this frame shows
+        u32 in_cnt;
+        struct offset_u16 org; // pixel position of cell (0,0), and the top left of the clip
+        s32 shift[2]; // pixels added to every cell, for scrolling by part of a cell
+        u16 top; // grid row drawn at row 0, rows after it wrap around the grid
+        struct gpu_pc prev_pc; // the push constants last presented, to find damage
+        VkImage last; // copy of the last presented image, null if the swapchain cannot copy
+        VkDeviceMemory last_mem;
+        bool last_ok; // last holds the presented image
         u32 in_use_fences; // bit mask
         VkSampleCountFlags msaa_samples;
     } db;
+    
+    // One draw info per cell of the window and its overscan, kept in GPU_BI_C between
+    // frames. Each frame is drawn into next, and only the rows that differ from cell are
+    // uploaded. Rows are a ring starting at db.top, so a scroll can keep the rows it
+    // does not expose where they are.
+    struct gpu_grid {
+        struct draw_info *cell; // as the device holds it
+        struct draw_info *next; // this frame, cleared after each flush
+        u16 cols,rows;
+        u32 used; // cells set this frame
+        bool stale; // the device copy is undefined, upload every row
+    } grid;
 };
 
 #ifdef LIB
@@ -161,9 +225,27 @@ def_gpu_handle_win_resize(gpu_handle_win_resize);
 #define def_gpu_update(name) int name(void)
 def_gpu_update(gpu_update);
 
-#define def_gpu_db_add(name) int name(struct rect_u16 rect, struct rgba fg, struct rgba bg)
+// Choose between fifo and the lowest latency present mode available, and how many
+// frames may be in flight, which sets the swapchain image count. Rebuilds the swapchain.
+#define def_gpu_set_latency(name) int name(bool low, u32 frames)
+def_gpu_set_latency(gpu_set_latency);
+
+// Add a cell drawn over the grid this frame only, such as a cursor.
+#define def_gpu_db_add(name) int name(u16 col, u16 row, u8 glyph, u8 pal)
 def_gpu_db_add(gpu_db_add);
 
+// Note a key this frame shows, so its latency is recorded when the frame is presented.
+#define def_gpu_db_add_input(name) void name(u64 tick)
+def_gpu_db_add_input(gpu_db_add_input);
+
+#define def_gpu_grid_set(name) int name(u16 col, u16 row, u8 glyph, u8 pal)
+def_gpu_grid_set(gpu_grid_set);
+
+// Set a row of grid cells starting at col, one cell per entry of g and GPU_GLYPH_NONE
+// for an empty one.
+#define def_gpu_grid_set_span(name) int name(u16 col, u16 row, const u8 *g, u32 cnt, u8 pal)
+def_gpu_grid_set_span(gpu_grid_set_span);
+
 #define def_gpu_db_flush(name) int name(void)
 def_gpu_db_flush(gpu_db_flush);
 
@@ -187,9 +269,7 @@ union gpu_memreq_info {
 };
 
 enum cell_vertex_fmts {
-    CELL_PD_FMT = VK_FORMAT_R16G16B16A16_UNORM,
-    CELL_FG_FMT = VK_FORMAT_R8G8B8A8_UNORM,
-    CELL_BG_FMT = VK_FORMAT_R8G8B8A8_UINT,
+    CELL_DI_FMT = VK_FORMAT_R16G16B16A16_UINT,
     CELL_GL_FMT = VK_FORMAT_R8_UNORM,
 };
 
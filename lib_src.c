@@ -14,4 +14,7 @@
 #include "win.c"
 #include "gpu.c"
 #include "vdt.c"
+#include "fio.c"
+#include "txb.c"
+#include "anc.c"
 #include "edm.c"
\ No newline at end of file
@@ -29,8 +29,10 @@ int load_lib(void)
     return 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
     exeprg.vdt.table = exevdt;
+    if (argc > 1)
+        exeprg.open_uri = argv[1];
     
     // cannot be called from inside the lib.
     if (SDL_Init(SDL_INIT_TIMER|SDL_INIT_VIDEO|SDL_INIT_EVENTS)) {
@@ -70,6 +70,57 @@ def_should_prg_reload(should_prg_reload)
 
 #define RLD_WT secs_to_ms(2) /* Time the hot reloader waits before checking for source changes */
 
+def_prg_lat_add(prg_lat_add)
+{
+    u64 d = SDL_GetPerformanceCounter() - tick;
+    u32 us = (u32)(d * 1000000 / SDL_GetPerformanceFrequency());
+    u32 b = us / LAT_BKT_US;
+    
+    struct lat_hist *h = &prg->lat;
+    h->bkt[b < LAT_BKT_CNT ? b : LAT_BKT_CNT - 1] += 1;
+    h->cnt += 1;
+    h->sum_us += us;
+    if (h->max_us < us)
+        h->max_us = us;
+}
+
+def_prg_lat_quantile(prg_lat_quantile)
+{
+    struct lat_hist *h = &prg->lat;
+    if (h->cnt == 0)
+        return 0;
+    
+    u32 want = (u32)ceilf(q * h->cnt);
+    u32 seen = 0;
+    for(u32 i=0; i < LAT_BKT_CNT - 1; ++i) {
+        seen += h->bkt[i];
+        if (seen >= want)
+            return (i + 1) * LAT_BKT_US;
+    }
+    return h->max_us;
+}
+
+def_prg_lat_dump(prg_lat_dump)
+{
+    struct lat_hist *h = &prg->lat;
+    if (h->cnt == 0) {
+        println("Input latency: no keys presented");
+        return;
+    }
+    
+    println("Input latency over %u keys (us): mean %u, p50 %u, p90 %u, p99 %u, max %u",
+            h->cnt, (u32)(h->sum_us / h->cnt), prg_lat_quantile(0.5f),
+            prg_lat_quantile(0.9f), prg_lat_quantile(0.99f), h->max_us);
+    for(u32 i=0; i < LAT_BKT_CNT; ++i) {
+        if (h->bkt[i] == 0)
+            continue;
+        if (i == LAT_BKT_CNT - 1)
+            println("    %u+: %u", i * LAT_BKT_US, h->bkt[i]);
+        else
+            println("    %u-%u: %u", i * LAT_BKT_US, (i + 1) * LAT_BKT_US, h->bkt[i]);
+    }
+}
+
 def_prg_update(prg_update)
 {
     for(u32 i=0; i < cl_array_size(prg->allocs); ++i) {
@@ -97,8 +148,10 @@ def_prg_update(prg_update)
     if (rld_timer < win_ms()) {
         rld_timer += RLD_WT;
         
-        if (cmpftim(FTIM_MOD, LIB_SRC, LIB_SRC_TEMP) < 0)
+        if (cmpftim(FTIM_MOD, LIB_SRC, LIB_SRC_TEMP) < 0) {
             prg->flags |= PRG_RLD;
+            edm_stop_workers();
+        }
         
         if (cmpftim(FTIM_MOD, SH_SRC_OUT_URI, SH_SRC_URI) < 0) {
             println("Recompiling shaders");
@@ -112,7 +165,24 @@ def_prg_update(prg_update)
     }
     
     /* window */
-    win_poll();
+    // Sleep until an event or the next deadline, whichever comes first, rather than
+    // redrawing an unchanged screen.
+    u32 now = win_ms();
+    u32 wait = rld_timer > now ? rld_timer - now : 0;
+    u32 edm_wait = edm_wait_ms();
+    if (edm_wait < wait)
+        wait = edm_wait;
+    if (prg->wake_ms) {
+        u32 anim_wait = prg->wake_ms > now ? prg->wake_ms - now : 0;
+        if (anim_wait < wait)
+            wait = anim_wait;
+    }
+    // nothing is presented while minimized, so damage waits for the restore event
+    if ((gpu->flags & GPU_DMG) && !(win->flags & WIN_MIN))
+        wait = 0;
+    win_poll(wait);
+    if (prg->wake_ms && prg->wake_ms <= win_ms())
+        prg->wake_ms = 0;
     
     if (win->flags & WIN_RSZ) {
         if (gpu_handle_win_resize()) {
@@ -121,33 +191,30 @@ def_prg_update(prg_update)
         }
     }
     
-    bool got_input = false;
-    
     // input
     struct keyboard_input ki;
     while(win_kb_next(&ki)) { // @Todo
-        got_input = true;
-        char c = win_key_to_char(ki);
         if (ki.mod & RELEASE) {
             continue;
         } else if (ki.key == KEY_ESCAPE) {
             win->flags |= WIN_CLO;
+            prg_lat_dump();
             gpu_check_leaks();
             return 0;
-        } else if (c > 0) {
-            println("Got input %c", c);
+        } else if (ki.key == KEY_F9) {
+            gpu_set_latency(!gpu->sc.low_latency, gpu->frames);
+        } else if (ki.key == KEY_F10) {
+            gpu_set_latency(gpu->sc.low_latency, gpu->frames % GPU_MAX_FRAMES + 1);
         } else {
-            println("Input is not a text char");
+            edm_input(ki);
         }
     }
     
     /* update */
+    // The view is redrawn on every wake, which is cheap next to presenting, and the
+    // gpu only presents it if it differs from the last frame.
     edm_update(); // call before gpu otherwise will be frame late
     gpu_update();
     
-    /* end frame */
-    if (!got_input)
-        os_sleep_ms(0); // relinquish time slice
-    
     return 0;
 }
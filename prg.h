@@ -18,7 +18,7 @@
 #define BG_GRN 255
 #define BG_BLU 255
 
-// alpha channel of bg holds char index
+// palette entries, fg alpha scales glyph coverage
 #define FG_COL ((struct rgba) {.r = FG_RED, .g = FG_GRN, .b = FG_BLU, .a = 255})
 #define BG_COL ((struct rgba) {.r = BG_RED, .g = BG_GRN, .b = BG_BLU, .a = 0})
 
@@ -28,6 +28,9 @@
 #define INIT_WIN_W 640
 #define INIT_WIN_H 480
 
+#define LAT_BKT_US 250 /* width of a latency histogram bucket */
+#define LAT_BKT_CNT 128 /* the last bucket also takes everything past it */
+
 #define TOTAL_MEM mb(32)
 #define MAX_THREADS 1 /* 1 == only main thread */
 #define MT 0
@@ -61,6 +64,14 @@ enum program_flags {
     PRG_RLD = 0x01,
 };
 
+// Time from a key arriving in win_poll to the present of the first frame showing it.
+struct lat_hist {
+    u32 bkt[LAT_BKT_CNT];
+    u32 cnt;
+    u32 max_us;
+    u64 sum_us;
+};
+
 struct program {
     struct {
         create_prg_t (*create);
@@ -79,6 +90,8 @@ struct program {
     struct vdt vdt;
     struct edm edm;
     
+    const char *open_uri; // file named on the command line
+    
     u32 flags;
     u32 thread_count;
     
@@ -87,11 +100,15 @@ struct program {
         u32 dms;
     } time;
     
+    u32 wake_ms; // when an animation next needs a frame, 0 for none
+    
     struct {
         u32 cnt;
         u32 avg; // 1ms
         u32 worst; // 7-10ms
     } frames;
+    
+    struct lat_hist lat;
 };
 
 #ifdef LIB
@@ -101,6 +118,24 @@ extern struct program *prg;
 #define salloc(thread_index, sz) allocate(&prg->allocs[thread_index].scratch, sz)
 #define palloc(thread_index, sz) allocate(&prg->allocs[thread_index].persist, sz)
 #define pfree(thread_index, p) deallocate(&prg->allocs[thread_index].persist, p)
+
+// Record the latency of a key that arrived at tick, a performance counter value.
+#define def_prg_lat_add(name) void name(u64 tick)
+def_prg_lat_add(prg_lat_add);
+
+// Latency in microseconds that a fraction q of keys came in under, to a bucket's width.
+#define def_prg_lat_quantile(name) u32 name(f32 q)
+def_prg_lat_quantile(prg_lat_quantile);
+
+#define def_prg_lat_dump(name) void name(void)
+def_prg_lat_dump(prg_lat_dump);
+
+// Ask for a frame by ms, the main loop otherwise sleeps until there is input.
+static inline void prg_wake_at(u32 ms)
+{
+    if (prg->wake_ms == 0 || ms < prg->wake_ms)
+        prg->wake_ms = ms;
+}
 #endif
 
 #endif // PRG_H
@@ -9,13 +9,15 @@
 
 #define SH_BEGIN
 
-#define SH_SI_CNT (126 - 33 + 1) /* 126 == tilde, 33 == exclamation mark */
+#define SH_SI_CNT (126 - 33 + 1 + 255 - 161 + 1 + 12) /* printable ascii, latin-1 from 161 == inverted exclamation mark, and the extra glyphs at the end of chars.h */
 #define SH_SI_SET 0 /* sampler descriptor set index */
 #define SH_SI_BND 0 /* sampler descriptor set binding */
+#define SH_GM_BND 1 /* glyph metrics and palette uniform binding, same set as the samplers */
 
-#define SH_PD_LOC 0
-#define SH_FG_LOC 1
-#define SH_BG_LOC 2
+#define SH_GM_CNT 256 /* glyph metrics entries, every value an instance glyph can hold */
+#define SH_PAL_CNT 2 /* fg,bg pairs in the palette, enum gpu_pal */
+
+#define SH_CELL_LOC 0
 
 #if GL_core_profile /* search token for gpu_compile_sh */
 
@@ -37,14 +39,26 @@ void pv4(vec4 v)
 /****************************************************/
 // Vertex shader
 
-// I would like to parse the spirv to get these automatically
-// but I don't think that the VkFormats would be correct
-// because I want to pass in normalized r8/r16, not float...
-layout(location = SH_PD_LOC) in vec4 pd;
-layout(location = SH_FG_LOC) in vec4 fg;
-layout(location = SH_BG_LOC) in uvec4 bg;
+// Glyph rects are relative to the baseline at the bottom of a cell. The palette holds
+// a fg and a bg for each entry.
+layout(set = SH_SI_SET, binding = SH_GM_BND) uniform gm_t {
+    ivec4 glyph[SH_GM_CNT];
+    vec4 pal[SH_PAL_CNT * 2];
+} gm;
+
+layout(push_constant) uniform pc_t {
+    vec2 rdim; // reciprocal of the window dimensions
+    ivec2 org; // pixel position of cell (0, 0)
+    ivec2 cell; // cell width and row pitch
+    ivec2 shift; // pixel offset of every cell, for scrolling by part of a cell
+    int top; // row drawn first, rows are a ring of pc.rows
+    int rows;
+} pc;
+
+layout(location = SH_CELL_LOC) in uvec4 cell; // col, row, glyph, palette entry
 
 layout(location = 0) out vf_info_t vf_info;
+layout(location = 3) flat out uint vf_glyph;
 
 vec2 offset[] = {
     vec2(0, 0),
@@ -59,13 +73,19 @@ uint index[] = {
 };
 
 void main() {
-    gl_Position.xy = vec2(-1, -1) + pd.xy * 2 + offset[index[gl_VertexIndex]] * pd.zw;
+    ivec4 g = gm.glyph[cell.z];
+    int row = (int(cell.y) - pc.top + pc.rows) % pc.rows;
+    vec2 ofs = vec2(pc.org + pc.shift + pc.cell * ivec2(cell.x, row + 1) + g.xy) * pc.rdim;
+    vec2 ext = vec2(g.zw) * pc.rdim;
+    
+    gl_Position.xy = vec2(-1, -1) + ofs * 2 + offset[index[gl_VertexIndex]] * ext;
     gl_Position.z = 0;
     gl_Position.w = 1;
     
-    vf_info.fg = fg;
-    vf_info.bg = bg;
+    vf_info.fg = gm.pal[cell.w * 2];
+    vf_info.bg = gm.pal[cell.w * 2 + 1];
     vf_info.tc = offset[index[gl_VertexIndex]] * 0.5;
+    vf_glyph = cell.z;
 }
 #else
 /****************************************************/
@@ -74,15 +94,16 @@ void main() {
 layout(set = SH_SI_SET, binding = SH_SI_BND) uniform sampler2D glyph[SH_SI_CNT];
 
 layout(location = 0) in vf_info_t vf_info;
+layout(location = 3) flat in uint vf_glyph;
 
 layout(location = 0) out vec4 fc;
 
 void main() {
-    uint c = uint(vf_info.bg.a);
-    vec3 bg = vf_info.bg.xyz / 255;
-    
-    float g = texture(glyph[nonuniformEXT(c)], vf_info.tc).r * vf_info.fg.a;
-    vec3 col = mix(bg, vf_info.fg.rgb, g);
+    // glyphs past the samplers, such as the block, are solid bg
+    float g = 0;
+    if (vf_glyph < SH_SI_CNT)
+        g = texture(glyph[nonuniformEXT(vf_glyph)], vf_info.tc).r * vf_info.fg.a;
+    vec3 col = mix(vf_info.bg.rgb, vf_info.fg.rgb, g);
     fc = vec4(col, 1);
 }
 #endif // shader switch
@@ -0,0 +1,781 @@
+#include "txb.h"
+#include "fio.h"
+#include <emmintrin.h>
+
+static inline u64 txb_sum(struct txb_node *n)
+{
+    return n ? n->sum : 0;
+}
+
+static inline u64 txb_sum_lf(struct txb_node *n)
+{
+    return n ? n->sum_lf : 0;
+}
+
+static inline void txb_update(struct txb_node *n)
+{
+    n->sum = txb_sum(n->l) + n->len + txb_sum(n->r);
+    n->sum_lf = txb_sum_lf(n->l) + n->lf + txb_sum_lf(n->r);
+    n->cnt = txb_tree_cnt(n->l) + 1 + txb_tree_cnt(n->r);
+}
+
+internal u64 txb_count_lf(const u8 *p, u64 len)
+{
+    __m128i nl = _mm_set1_epi8('\n');
+    __m128i z = _mm_setzero_si128();
+    u64 cnt = 0;
+    u64 i = 0;
+    
+    while(len - i >= 16) {
+        // Per byte lane counters, flushed before they can overflow.
+        u64 blk = (len - i) / 16;
+        if (blk > 255)
+            blk = 255;
+        
+        __m128i acc = z;
+        for(u64 j=0; j < blk; ++j, i += 16)
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), nl));
+        
+        acc = _mm_sad_epu8(acc, z);
+        cnt += (u64)_mm_cvtsi128_si32(acc) + (u64)_mm_extract_epi16(acc, 4);
+    }
+    for(; i < len; ++i)
+        cnt += p[i] == '\n';
+    return cnt;
+}
+
+def_txb_count_chunks(txb_count_chunks)
+{
+    for(u64 k = from; k < to; ++k)
+        lf[k+1] = lf[k] + txb_count_lf(data + (k << TXB_LF_SHIFT), TXB_LF_CHUNK);
+}
+
+// Newlines in buf before ofs, ofs must not be past size.
+internal u64 txb_buf_lf_before(struct txb_buf *b, u64 ofs)
+{
+    u64 k = ofs >> TXB_LF_SHIFT;
+    return b->lf[k] + txb_count_lf(b->data + (k << TXB_LF_SHIFT), ofs - (k << TXB_LF_SHIFT));
+}
+
+internal u64 txb_buf_lf_range(struct txb_buf *b, u64 ofs, u64 len)
+{
+    if (len <= TXB_LF_CHUNK)
+        return txb_count_lf(b->data + ofs, len);
+    return txb_buf_lf_before(b, ofs + len) - txb_buf_lf_before(b, ofs);
+}
+
+// Offset just past the nth newline in [ofs,end), which the caller knows to exist. Only
+// reads what a piece ending at end can see, so it is safe on snapshots.
+internal u64 txb_buf_find_lf(struct txb_buf *b, u64 ofs, u64 end, u64 nth)
+{
+    u64 want = txb_buf_lf_before(b, ofs) + nth;
+    
+    // last chunk that starts with fewer newlines before it than wanted
+    u64 lo = ofs >> TXB_LF_SHIFT;
+    u64 hi = end >> TXB_LF_SHIFT;
+    while(lo < hi) {
+        u64 mid = lo + (hi - lo + 1) / 2;
+        if (b->lf[mid] < want)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    
+    u64 i = lo << TXB_LF_SHIFT;
+    u64 cnt = b->lf[lo];
+    if (i < ofs) {
+        i = ofs;
+        cnt = want - nth;
+    }
+    while(true) {
+        const u8 *f = memchr(b->data + i, '\n', end - i);
+        if (!f) {
+            log_error("Newline index is out of sync with its buffer");
+            return end;
+        }
+        i = (u64)(f - b->data) + 1;
+        if (++cnt == want)
+            return i;
+    }
+}
+
+// Mark len more bytes of buf as filled, completing the index for any finished chunks.
+internal void txb_buf_extend(struct txb_buf *b, u64 len)
+{
+    u64 k = (b->size > b->indexed ? b->size : b->indexed) >> TXB_LF_SHIFT;
+    b->size += len;
+    if (k < b->size >> TXB_LF_SHIFT)
+        txb_count_chunks(b->data, b->lf, k, b->size >> TXB_LF_SHIFT);
+}
+
+// Memory for a buffer or index, mapped from the OS past the size of an add block, so
+// alloc only ever has to hand out up to TXB_ADD_BLK_SZ at once however big the file or
+// an insert is.
+internal void* txb_alloc_big(struct txb *t, u64 sz)
+{
+    if (sz <= TXB_ADD_BLK_SZ)
+        return allocate(t->alloc, sz);
+    return fio_map_anon(sz);
+}
+
+// Register a buffer of cap bytes, none of which are filled yet.
+internal struct txb_buf* txb_add_buf(struct txb *t, const u8 *data, u64 cap)
+{
+    if (t->buf_cnt == t->buf_cap) {
+        u32 c = t->buf_cap ? t->buf_cap * 2 : 16;
+        struct txb_buf *b = allocate(t->alloc, sizeof(*b) * c);
+        if (!b) {
+            log_error("Failed to grow text buffer table to %u entries", c);
+            return NULL;
+        }
+        if (t->buf_cnt)
+            memcpy(b, t->buf, sizeof(*b) * t->buf_cnt);
+        t->buf = b;
+        t->buf_cap = c;
+    }
+    
+    u64 *lf = txb_alloc_big(t, sizeof(*lf) * ((cap >> TXB_LF_SHIFT) + 1));
+    if (!lf) {
+        log_error("Failed to allocate newline index for %u bytes", cap);
+        return NULL;
+    }
+    lf[0] = 0;
+    
+    struct txb_buf *b = &t->buf[t->buf_cnt++];
+    b->data = data;
+    b->size = 0;
+    b->indexed = 0;
+    b->cap = cap;
+    b->lf = lf;
+    return b;
+}
+
+static inline u32 txb_rand(struct txb *t)
+{
+    // xorshift32
+    u32 x = t->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    t->seed = x;
+    return x;
+}
+
+// Make sure that at least cnt nodes are on the free list, plus the copies of any paths
+// shared with snapshots, so that nothing which runs after a successful reserve can fail
+// halfway through restructuring the tree.
+internal int txb_reserve(struct txb *t, u32 cnt)
+{
+    while(t->free_cnt < cnt + TXB_COPY_CNT) {
+        struct txb_node *slab = allocate(t->alloc, sizeof(*slab) * TXB_SLAB_CNT);
+        if (!slab) {
+            log_error("Failed to allocate text buffer node slab");
+            return -1;
+        }
+        for(u32 i=0; i < TXB_SLAB_CNT - 1; ++i)
+            slab[i].l = &slab[i+1];
+        slab[TXB_SLAB_CNT - 1].l = t->free;
+        t->free = slab;
+        t->free_cnt += TXB_SLAB_CNT;
+    }
+    return 0;
+}
+
+internal struct txb_node* txb_alloc_node(struct txb *t, u32 bi, const u8 *p, u64 len, u64 lf)
+{
+    log_error_if(!t->free, "Text buffer node allocated without a reserve");
+    
+    struct txb_node *n = t->free;
+    t->free = n->l;
+    t->free_cnt -= 1;
+    
+    n->l = n->r = NULL;
+    n->p = p;
+    n->len = len;
+    n->sum = len;
+    n->lf = lf;
+    n->sum_lf = lf;
+    n->cnt = 1;
+    n->ref = 1;
+    n->bi = bi;
+    n->prio = txb_rand(t);
+    return n;
+}
+
+// Make n safe to modify. A node that snapshots or other trees also point to is copied,
+// and the copy shares its children.
+internal struct txb_node* txb_own(struct txb *t, struct txb_node *n)
+{
+    if (!n || n->ref == 1)
+        return n;
+    
+    log_error_if(!t->free, "Text buffer node copied without a reserve");
+    struct txb_node *c = t->free;
+    t->free = c->l;
+    t->free_cnt -= 1;
+    
+    *c = *n;
+    c->ref = 1;
+    if (c->l)
+        c->l->ref += 1;
+    if (c->r)
+        c->r->ref += 1;
+    n->ref -= 1;
+    return c;
+}
+
+// Drop a reference to subtree n, freeing the nodes that nothing else points to.
+internal void txb_free_tree(struct txb *t, struct txb_node *n)
+{
+    while(n && --n->ref == 0) {
+        txb_free_tree(t, n->r);
+        struct txb_node *l = n->l;
+        n->l = t->free;
+        t->free = n;
+        t->free_cnt += 1;
+        n = l;
+    }
+}
+
+internal struct txb_node* txb_merge(struct txb *t, struct txb_node *a, struct txb_node *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    
+    if (a->prio > b->prio) {
+        a = txb_own(t, a);
+        a->r = txb_merge(t, a->r, b);
+        txb_update(a);
+        return a;
+    } else {
+        b = txb_own(t, b);
+        b->l = txb_merge(t, a, b->l);
+        txb_update(b);
+        return b;
+    }
+}
+
+// Split n so that l holds the first pos bytes of the document and r holds the rest.
+// A piece straddling pos is cut in two, which takes one node from the reserve.
+internal void txb_split(struct txb *t, struct txb_node *n, u64 pos, struct txb_node **l, struct txb_node **r)
+{
+    if (!n) {
+        *l = *r = NULL;
+        return;
+    }
+    
+    n = txb_own(t, n);
+    u64 ls = txb_sum(n->l);
+    if (pos <= ls) {
+        txb_split(t, n->l, pos, l, &n->l);
+        txb_update(n);
+        *r = n;
+    } else if (pos >= ls + n->len) {
+        txb_split(t, n->r, pos - ls - n->len, &n->r, r);
+        txb_update(n);
+        *l = n;
+    } else {
+        u64 k = pos - ls;
+        struct txb_buf *b = &t->buf[n->bi];
+        u64 lf = txb_buf_lf_range(b, (u64)(n->p - b->data), k);
+        
+        struct txb_node *m = txb_alloc_node(t, n->bi, n->p + k, n->len - k, n->lf - lf);
+        struct txb_node *nr = n->r;
+        n->r = NULL;
+        n->len = k;
+        n->lf = lf;
+        txb_update(n);
+        
+        *l = n;
+        *r = txb_merge(t, m, nr);
+    }
+}
+
+// Copy data to the end of the add buffer, returning the block index and the copy. An
+// insert bigger than an add block gets a block of its own, sized to it.
+internal const u8* txb_append(struct txb *t, const u8 *data, u64 len, u32 *bi)
+{
+    struct txb_buf *b = &t->buf[t->buf_cnt - 1];
+    if (t->buf_cnt == 1 || b->cap - b->size < len) {
+        u64 sz = len > TXB_ADD_BLK_SZ ? len : TXB_ADD_BLK_SZ;
+        u8 *blk = txb_alloc_big(t, sz);
+        if (!blk) {
+            log_error("Failed to allocate text buffer add block (%u bytes)", sz);
+            return NULL;
+        }
+        b = txb_add_buf(t, blk, sz);
+        if (!b)
+            return NULL;
+    }
+    
+    u8 *p = (u8*)b->data + b->size;
+    memcpy(p, data, len);
+    txb_buf_extend(b, len);
+    *bi = t->buf_cnt - 1;
+    return p;
+}
+
+// Add a piece to the end of the document l, extending its last piece instead when the
+// new data directly follows it in the same buffer. Needs one reserved node.
+internal struct txb_node* txb_push_back(struct txb *t, struct txb_node *l, u32 bi, const u8 *p, u64 len, u64 lf)
+{
+    struct txb_node *rm = l;
+    while(rm && rm->r)
+        rm = rm->r;
+    
+    if (rm && rm->bi == bi && rm->p + rm->len == p) {
+        l = txb_own(t, l);
+        for(struct txb_node *n = l;; n = n->r) {
+            n->sum += len;
+            n->sum_lf += lf;
+            if (!n->r) {
+                n->len += len;
+                n->lf += lf;
+                break;
+            }
+            n->r = txb_own(t, n->r);
+        }
+        return l;
+    }
+    return txb_merge(t, l, txb_alloc_node(t, bi, p, len, lf));
+}
+
+def_create_txb(create_txb)
+{
+    memset(t, 0, sizeof(*t));
+    t->alloc = alloc;
+    t->seed = 0x9e3779b9;
+    
+    // the original buffer joins the document as txb_load reaches it
+    if (!txb_add_buf(t, (const u8*)orig.data, orig.size))
+        return -1;
+    return 0;
+}
+
+def_txb_load(txb_load)
+{
+    struct txb_buf *b = &t->buf[TXB_BI_ORIG];
+    if (pos <= b->size || b->size == b->cap)
+        return 0;
+    if (txb_reserve(t, 1))
+        return -1;
+    
+    // load whole index chunks
+    u64 end = b->cap;
+    if (pos < end && ((pos + TXB_LF_CHUNK - 1) & ~(u64)(TXB_LF_CHUNK - 1)) < end)
+        end = (pos + TXB_LF_CHUNK - 1) & ~(u64)(TXB_LF_CHUNK - 1);
+    
+    u64 ofs = b->size;
+    txb_buf_extend(b, end - ofs);
+    
+    // Everything before the loaded boundary is already in the document, edited or not,
+    // so the newly loaded bytes always go at its end.
+    u64 lf = txb_buf_lf_before(b, end) - txb_buf_lf_before(b, ofs);
+    t->root = txb_push_back(t, t->root, TXB_BI_ORIG, b->data + ofs, end - ofs, lf);
+    return 0;
+}
+
+def_txb_load_indexed(txb_load_indexed)
+{
+    struct txb_buf *b = &t->buf[TXB_BI_ORIG];
+    if (pos > b->indexed)
+        b->indexed = pos;
+    return txb_load(t, pos);
+}
+
+def_txb_insert(txb_insert)
+{
+    if (len == 0)
+        return 0;
+    if (pos > txb_size(t)) {
+        log_error("Text buffer insert position %u is beyond the end of the buffer (%u)", pos, txb_size(t));
+        return -1;
+    }
+    
+    if (txb_reserve(t, 2))
+        return -1;
+    
+    u32 bi;
+    const u8 *p = txb_append(t, data, len, &bi);
+    if (!p)
+        return -1;
+    
+    struct txb_node *l,*r;
+    txb_split(t, t->root, pos, &l, &r);
+    
+    // Typing appends to the add block right behind the previous keystroke, so the
+    // piece to the left of pos can usually just be extended.
+    l = txb_push_back(t, l, bi, p, len, txb_count_lf(p, len));
+    t->root = txb_merge(t, l, r);
+    return 0;
+}
+
+def_txb_delete(txb_delete)
+{
+    u64 sz = txb_size(t);
+    if (pos > sz || len > sz - pos) {
+        log_error("Text buffer delete of %u bytes at %u is beyond the end of the buffer (%u)", len, pos, sz);
+        return -1;
+    }
+    if (len == 0)
+        return 0;
+    
+    struct txb_node *m;
+    if (txb_swap(t, pos, len, NULL, &m))
+        return -1;
+    txb_free_tree(t, m);
+    return 0;
+}
+
+def_txb_swap(txb_swap)
+{
+    u64 sz = txb_size(t);
+    if (pos > sz) {
+        log_error("Text buffer swap position %u is beyond the end of the buffer (%u)", pos, sz);
+        return -1;
+    }
+    if (len > sz - pos)
+        len = sz - pos;
+    if (txb_reserve(t, 2))
+        return -1;
+    
+    struct txb_node *l,*r;
+    txb_split(t, t->root, pos, &l, &r);
+    txb_split(t, r, len, out, &r);
+    
+    t->root = txb_merge(t, txb_merge(t, l, with), r);
+    return 0;
+}
+
+// State of a batched edit while the region it covers is rebuilt. The new pieces come
+// in document order, so the treap is built bottom up along its right spine instead of
+// merging them in one at a time.
+struct txb_batch_state {
+    struct txb *t;
+    const u64 *pos;
+    u32 cnt;
+    u32 i; // next range
+    u64 at; // document offset of the next byte of the old region
+    u64 del;
+    u64 skip; // bytes of the current range still to be dropped
+    u32 bi; // the inserted text
+    const u8 *p;
+    u64 len, lf;
+    struct txb_node *l; // document before the region
+    struct txb_node *res; // finished part of the rebuilt region, when the spine overflowed
+    struct txb_node *last; // last piece, still open to being extended
+    u32 depth;
+    struct txb_node *spine[TXB_ITER_DEPTH]; // right spine of the rebuilt region
+};
+
+// Close the right spine into a subtree and merge it onto res.
+internal void txb_batch_close(struct txb_batch_state *s)
+{
+    while(s->depth > 1)
+        txb_update(s->spine[--s->depth]);
+    if (s->depth) {
+        txb_update(s->spine[0]);
+        s->res = txb_merge(s->t, s->res, s->spine[0]);
+        s->depth = 0;
+    }
+}
+
+internal void txb_batch_push(struct txb_batch_state *s, struct txb_node *n)
+{
+    if (s->depth == TXB_ITER_DEPTH)
+        txb_batch_close(s);
+    
+    struct txb_node *c = NULL;
+    while(s->depth && s->spine[s->depth-1]->prio < n->prio) {
+        c = s->spine[--s->depth];
+        txb_update(c);
+    }
+    n->l = c;
+    if (s->depth)
+        s->spine[s->depth-1]->r = n;
+    s->spine[s->depth++] = n;
+}
+
+// At every range the inserted text directly follows what was typed there before, so
+// extending the last piece keeps the piece count down. Before the region has a piece
+// of its own, the last piece is the one before the region.
+internal void txb_batch_emit(struct txb_batch_state *s, u32 bi, const u8 *p, u64 len, u64 lf)
+{
+    if (!len)
+        return;
+    
+    struct txb_node *n = s->last;
+    if (n && n->bi == bi && n->p + n->len == p) {
+        n->len += len;
+        n->lf += lf;
+        return;
+    }
+    if (!n && !s->res && !s->depth) {
+        struct txb_node *rm = s->l;
+        while(rm && rm->r)
+            rm = rm->r;
+        if (rm && rm->bi == bi && rm->p + rm->len == p) {
+            s->l = txb_push_back(s->t, s->l, bi, p, len, lf);
+            return;
+        }
+    }
+    
+    if (n)
+        txb_batch_push(s, n);
+    s->last = txb_alloc_node(s->t, bi, p, len, lf);
+}
+
+internal void txb_batch_range(struct txb_batch_state *s)
+{
+    txb_batch_emit(s, s->bi, s->p, s->len, s->lf);
+    s->skip = s->del;
+    s->i += 1;
+}
+
+internal void txb_batch_piece(struct txb_batch_state *s, struct txb_node *n)
+{
+    if (!n)
+        return;
+    
+    txb_batch_piece(s, n->l);
+    
+    struct txb_buf *b = &s->t->buf[n->bi];
+    u64 off = 0;
+    while(off < n->len) {
+        u64 k = n->len - off;
+        if (s->skip) {
+            k = k < s->skip ? k : s->skip;
+            s->skip -= k;
+        } else if (s->i < s->cnt && s->pos[s->i] == s->at) {
+            txb_batch_range(s);
+            continue;
+        } else {
+            if (s->i < s->cnt && s->pos[s->i] - s->at < k)
+                k = s->pos[s->i] - s->at;
+            u64 lf = k == n->len ? n->lf : txb_buf_lf_range(b, (u64)(n->p - b->data) + off, k);
+            txb_batch_emit(s, n->bi, n->p + off, k, lf);
+        }
+        off += k;
+        s->at += k;
+    }
+    
+    txb_batch_piece(s, n->r);
+}
+
+def_txb_batch(txb_batch)
+{
+    *out = NULL;
+    if (!cnt || (!del && !len))
+        return 0;
+    
+    u64 sz = txb_size(t);
+    for(u32 i=0; i < cnt; ++i) {
+        if (pos[i] > sz || del > sz - pos[i] || (i && pos[i] < pos[i-1] + del)) {
+            log_error("Text buffer batch range %u (%u+%u) is out of order or beyond the end of the buffer (%u)", i, pos[i], del, sz);
+            return -1;
+        }
+    }
+    
+    struct txb_batch_state s = {.t = t, .pos = pos, .cnt = cnt, .at = pos[0], .del = del, .len = len};
+    if (len) {
+        s.p = txb_append(t, data, len, &s.bi);
+        if (!s.p)
+            return -1;
+        s.lf = txb_count_lf(s.p, len);
+    }
+    
+    struct txb_node *m,*r;
+    if (txb_reserve(t, 2))
+        return -1;
+    txb_split(t, t->root, pos[0], &s.l, &r);
+    txb_split(t, r, pos[cnt-1] + del - pos[0], &m, &r);
+    
+    // every range can cut a piece at both of its ends and adds one piece of its own
+    if (txb_reserve(t, txb_tree_cnt(m) + 3 * cnt)) {
+        t->root = txb_merge(t, txb_merge(t, s.l, m), r);
+        return -1;
+    }
+    
+    txb_batch_piece(&s, m);
+    while(s.i < cnt)
+        txb_batch_range(&s);
+    if (s.last)
+        txb_batch_push(&s, s.last);
+    txb_batch_close(&s);
+    
+    t->root = txb_merge(t, txb_merge(t, s.l, s.res), r);
+    *out = m;
+    return 0;
+}
+
+def_txb_snapshot(txb_snapshot)
+{
+    *snap = *t;
+    snap->free = NULL;
+    snap->free_cnt = 0;
+    if (t->root)
+        t->root->ref += 1;
+}
+
+def_txb_drop(txb_drop)
+{
+    txb_free_tree(t, snap->root);
+    snap->root = NULL;
+}
+
+def_txb_join(txb_join)
+{
+    return txb_merge(t, a, b);
+}
+
+def_txb_release(txb_release)
+{
+    txb_free_tree(t, n);
+}
+
+def_txb_iter_seek(txb_iter_seek)
+{
+    it->t = t;
+    it->depth = 0;
+    
+    struct txb_node *n = t->root;
+    u64 base = 0;
+    
+    if (pos >= txb_size(t)) {
+        it->n = NULL;
+        it->s = it->e = NULL;
+        it->base = txb_size(t);
+        return false;
+    }
+    
+    while(n) {
+        u64 ls = txb_sum(n->l);
+        if (pos < ls) {
+            if (it->depth == TXB_ITER_DEPTH) {
+                log_error("Text buffer tree is deeper than the iterator stack (%u)", TXB_ITER_DEPTH);
+                return false;
+            }
+            it->stk[it->depth++] = n;
+            n = n->l;
+        } else if (pos >= ls + n->len) {
+            pos -= ls + n->len;
+            base += ls + n->len;
+            n = n->r;
+        } else {
+            base += ls;
+            it->n = n;
+            it->s = n->p;
+            it->e = n->p + n->len;
+            it->base = base;
+            return true;
+        }
+    }
+    return false;
+}
+
+def_txb_iter_next(txb_iter_next)
+{
+    if (!it->n)
+        return false;
+    
+    u64 base = it->base + (u64)(it->e - it->s);
+    struct txb_node *n = it->n->r;
+    
+    if (n) {
+        while(n->l) {
+            if (it->depth == TXB_ITER_DEPTH) {
+                log_error("Text buffer tree is deeper than the iterator stack (%u)", TXB_ITER_DEPTH);
+                it->n = NULL;
+                return false;
+            }
+            it->stk[it->depth++] = n;
+            n = n->l;
+        }
+    } else if (it->depth) {
+        n = it->stk[--it->depth];
+    } else {
+        it->n = NULL;
+        it->s = it->e = NULL;
+        it->base = base;
+        return false;
+    }
+    
+    it->n = n;
+    it->s = n->p;
+    it->e = n->p + n->len;
+    it->base = base;
+    return true;
+}
+
+def_txb_find_char(txb_find_char)
+{
+    struct txb_iter it;
+    if (!txb_iter_seek(t, &it, pos))
+        return Max_u64;
+    
+    const u8 *s = it.s + (pos - it.base);
+    do {
+        const u8 *f = memchr(s, c, (u64)(it.e - s));
+        if (f)
+            return it.base + (u64)(f - it.s);
+        if (!txb_iter_next(&it))
+            break;
+        s = it.s;
+    } while(true);
+    
+    return Max_u64;
+}
+
+def_txb_line_start(txb_line_start)
+{
+    if (line == 0 || !t->root)
+        return 0;
+    if (line > t->root->sum_lf)
+        line = t->root->sum_lf;
+    
+    // find the piece holding the newline that ends the previous line
+    struct txb_node *n = t->root;
+    u64 base = 0;
+    while(n) {
+        u64 ll = txb_sum_lf(n->l);
+        if (line <= ll) {
+            n = n->l;
+        } else if (line <= ll + n->lf) {
+            struct txb_buf *b = &t->buf[n->bi];
+            u64 ofs = (u64)(n->p - b->data);
+            return base + txb_sum(n->l) + txb_buf_find_lf(b, ofs, ofs + n->len, line - ll) - ofs;
+        } else {
+            line -= ll + n->lf;
+            base += txb_sum(n->l) + n->len;
+            n = n->r;
+        }
+    }
+    log_error("Text buffer newline counts are inconsistent");
+    return 0;
+}
+
+def_txb_pos_to_lc(txb_pos_to_lc)
+{
+    struct txb_lc lc = {};
+    if (pos > txb_size(t))
+        pos = txb_size(t);
+    
+    struct txb_node *n = t->root;
+    u64 p = pos;
+    while(n) {
+        u64 ls = txb_sum(n->l);
+        if (p < ls) {
+            n = n->l;
+        } else if (p < ls + n->len) {
+            struct txb_buf *b = &t->buf[n->bi];
+            lc.line += txb_sum_lf(n->l) + txb_buf_lf_range(b, (u64)(n->p - b->data), p - ls);
+            break;
+        } else {
+            lc.line += txb_sum_lf(n->l) + n->lf;
+            p -= ls + n->len;
+            n = n->r;
+        }
+    }
+    lc.col = pos - txb_line_start(t, lc.line);
+    return lc;
+}
@@ -0,0 +1,199 @@
+#ifndef TXB_H
+#define TXB_H
+
+#include "../solh/sol.h"
+
+// Piece table text buffer. The document is a sequence of pieces, each one a span of
+// either the read-only original buffer or one of the append-only add blocks. Pieces
+// live in a treap ordered by document position, with each node caching the length of
+// its subtree, so insert, delete and offset lookup are O(log pieces).
+//
+// Nodes also cache the newline count of their piece and subtree, so mapping between
+// lines and offsets is a single descent. The count for a piece created by a split is
+// taken from a per-buffer index of newlines per TXB_LF_CHUNK bytes, which makes it cost
+// at most one chunk scan regardless of the piece length.
+//
+// The original buffer is brought into the document lazily by txb_load, which is what
+// keeps a mapped file from being read past the point the editor has looked at.
+//
+// Nodes are reference counted and copied on write, so a snapshot of the document is
+// just another reference to the root. Edits copy the nodes on their path that a
+// snapshot can still see and leave the rest shared, and a worker thread can read a
+// snapshot without locks because nothing it can reach is ever modified.
+
+#define TXB_ADD_BLK_SZ mb(1) /* size of each append-only add block */
+#define TXB_SLAB_CNT 2048 /* nodes allocated per node slab */
+#define TXB_ITER_DEPTH 128 /* max treap depth the iterator can track */
+#define TXB_COPY_CNT (8 * TXB_ITER_DEPTH) /* nodes an edit may copy off paths shared with snapshots */
+#define TXB_LF_SHIFT 12
+#define TXB_LF_CHUNK (1 << TXB_LF_SHIFT) /* bytes per newline index entry */
+
+enum {
+    TXB_BI_ORIG, // original buffer, add blocks are numbered from 1
+};
+
+struct txb_node {
+    struct txb_node *l,*r;
+    const u8 *p; // piece data
+    u64 len; // piece length
+    u64 sum; // length of subtree
+    u64 lf; // newlines in piece
+    u64 sum_lf; // newlines in subtree
+    u32 bi; // buffer index
+    u32 prio; // treap heap priority
+    u32 cnt; // nodes in subtree
+    u32 ref; // parents, trees and snapshots pointing to the node
+};
+
+// A buffer that pieces point into. Bytes are only ever appended, so the newline index
+// is a plain prefix count: lf[i] is the number of newlines before chunk i, and it is
+// valid for every chunk that starts at or before size.
+struct txb_buf {
+    const u8 *data;
+    u64 size; // bytes filled
+    u64 cap;
+    u64 indexed; // bytes whose chunks were already counted by a loader thread
+    u64 *lf;
+};
+
+struct txb {
+    struct txb_node *root;
+    struct txb_node *free; // node free list, linked through l
+    allocator_t *alloc;
+    struct txb_buf *buf; // original buffer followed by the add blocks
+    u32 buf_cnt;
+    u32 buf_cap;
+    u32 seed; // priority rng state
+    u32 free_cnt;
+};
+
+struct txb_lc {
+    u64 line;
+    u64 col; // bytes from the start of the line
+};
+
+// Walks the document one contiguous span at a time.
+struct txb_iter {
+    struct txb *t;
+    struct txb_node *n; // node holding the current span
+    const u8 *s,*e; // current span [s,e)
+    u64 base; // document offset of s
+    u32 depth;
+    struct txb_node *stk[TXB_ITER_DEPTH]; // ancestors still to be visited
+};
+
+// Size of the loaded part of the document.
+static inline u64 txb_size(struct txb *t)
+{
+    return t->root ? t->root->sum : 0;
+}
+
+// Length and node count of a subtree detached by txb_swap.
+static inline u64 txb_tree_len(struct txb_node *n)
+{
+    return n ? n->sum : 0;
+}
+
+static inline u32 txb_tree_cnt(struct txb_node *n)
+{
+    return n ? n->cnt : 0;
+}
+
+static inline bool txb_loaded(struct txb *t)
+{
+    return t->buf[TXB_BI_ORIG].size == t->buf[TXB_BI_ORIG].cap;
+}
+
+static inline u64 txb_line_cnt(struct txb *t)
+{
+    return t->root ? t->root->sum_lf + 1 : 1;
+}
+
+#ifdef LIB
+#define def_create_txb(name) int name(struct string orig, allocator_t *alloc, struct txb *t)
+def_create_txb(create_txb);
+
+// Load the original buffer into the document up to at least pos.
+#define def_txb_load(name) int name(struct txb *t, u64 pos)
+def_txb_load(txb_load);
+
+// Fill lf[from+1..to] with the newline counts of chunks [from,to) of data. Touches
+// nothing else, so a loader thread can run it ahead of the loaded part of a buffer.
+#define def_txb_count_chunks(name) void name(const u8 *data, u64 *lf, u64 from, u64 to)
+def_txb_count_chunks(txb_count_chunks);
+
+// txb_load for original buffer bytes that txb_count_chunks has already indexed.
+#define def_txb_load_indexed(name) int name(struct txb *t, u64 pos)
+def_txb_load_indexed(txb_load_indexed);
+
+#define def_txb_insert(name) int name(struct txb *t, u64 pos, const u8 *data, u64 len)
+def_txb_insert(txb_insert);
+
+// Fails if [pos,pos+len) is not all in the document.
+#define def_txb_delete(name) int name(struct txb *t, u64 pos, u64 len)
+def_txb_delete(txb_delete);
+
+// Replace [pos,pos+len) with the pieces of a detached subtree, which may be NULL, and
+// hand back the pieces that were there as a new detached subtree in out. Detached
+// subtrees stay valid however the document changes afterwards, so an edit can be
+// undone by swapping back what it took out. O(log pieces) regardless of the length
+// of either side.
+#define def_txb_swap(name) int name(struct txb *t, u64 pos, u64 len, struct txb_node *with, struct txb_node **out)
+def_txb_swap(txb_swap);
+
+// Replace each of the sorted, non-overlapping ranges [pos[i],pos[i]+del) with the same
+// len bytes of data. The text is stored once and the pieces from the first range to
+// the end of the last are rebuilt in a single pass, so the whole batch is one region
+// whose old pieces are handed back in out, ready for txb_swap to put back.
+#define def_txb_batch(name) int name(struct txb *t, const u64 *pos, u32 cnt, u64 del, const u8 *data, u64 len, struct txb_node **out)
+def_txb_batch(txb_batch);
+
+// Take an O(1) snapshot of the document into snap. Any thread can query the snapshot as
+// a read-only text buffer while t goes on being edited, until the thread that edits t
+// drops it. Only the nodes the snapshot was the last one to see are freed then.
+#define def_txb_snapshot(name) void name(struct txb *t, struct txb *snap)
+def_txb_snapshot(txb_snapshot);
+
+#define def_txb_drop(name) void name(struct txb *t, struct txb *snap)
+def_txb_drop(txb_drop);
+
+// Concatenate detached subtrees, a before b.
+#define def_txb_join(name) struct txb_node* name(struct txb *t, struct txb_node *a, struct txb_node *b)
+def_txb_join(txb_join);
+
+// Return the nodes of a detached subtree to the buffer.
+#define def_txb_release(name) void name(struct txb *t, struct txb_node *n)
+def_txb_release(txb_release);
+
+#define def_txb_iter_seek(name) bool name(struct txb *t, struct txb_iter *it, u64 pos)
+def_txb_iter_seek(txb_iter_seek);
+
+#define def_txb_iter_next(name) bool name(struct txb_iter *it)
+def_txb_iter_next(txb_iter_next);
+
+#define def_txb_find_char(name) u64 name(struct txb *t, u64 pos, char c)
+def_txb_find_char(txb_find_char);
+
+// Offset of the first byte of line, lines past the end map to the start of the last line.
+#define def_txb_line_start(name) u64 name(struct txb *t, u64 line)
+def_txb_line_start(txb_line_start);
+
+#define def_txb_pos_to_lc(name) struct txb_lc name(struct txb *t, u64 pos)
+def_txb_pos_to_lc(txb_pos_to_lc);
+
+// Offset of the newline ending line, or the buffer size for the last line.
+static inline u64 txb_line_end(struct txb *t, u64 line)
+{
+    return line + 1 < txb_line_cnt(t) ? txb_line_start(t, line + 1) - 1 : txb_size(t);
+}
+
+// Returns the byte at pos, seeking the iterator only when pos is outside its span.
+static inline u8 txb_byte(struct txb_iter *it, u64 pos)
+{
+    if (pos - it->base >= (u64)(it->e - it->s) && !txb_iter_seek(it->t, it, pos))
+        return 0;
+    return it->s[pos - it->base];
+}
+#endif // LIB
+
+#endif // TXB_H
@@ -79,6 +79,8 @@ struct vdt_elem exevdt[VDT_SIZE] = {
     [VDT_CmdPipelineBarrier2] = {.name = "vkCmdPipelineBarrier2"},
     [VDT_CmdCopyBuffer] = {.name = "vkCmdCopyBuffer"},
     [VDT_CmdCopyBufferToImage] = {.name = "vkCmdCopyBufferToImage"},
+    [VDT_CmdCopyImage] = {.name = "vkCmdCopyImage"},
+    [VDT_CmdClearAttachments] = {.name = "vkCmdClearAttachments"},
     [VDT_CmdBeginRenderPass2] = {.name = "vkCmdBeginRenderPass2"},
     [VDT_CmdBindPipeline] = {.name = "vkCmdBindPipeline"},
     [VDT_CmdBindDescriptorSets] = {.name = "vkCmdBindDescriptorSets"},
@@ -87,6 +89,7 @@ struct vdt_elem exevdt[VDT_SIZE] = {
     [VDT_CmdEndRenderPass] = {.name = "vkCmdEndRenderPass"},
     [VDT_CmdSetViewport] = {.name = "vkCmdSetViewport"},
     [VDT_CmdSetScissor] = {.name = "vkCmdSetScissor"},
+    [VDT_CmdPushConstants] = {.name = "vkCmdPushConstants"},
     
     // Queue
     [VDT_GetDeviceQueue] = {.name = "vkGetDeviceQueue"},
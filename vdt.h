@@ -86,6 +86,8 @@ enum {
     VDT_CmdPipelineBarrier2,
     VDT_CmdCopyBuffer,
     VDT_CmdCopyBufferToImage,
+    VDT_CmdCopyImage,
+    VDT_CmdClearAttachments,
     VDT_CmdBeginRenderPass2,
     VDT_CmdBindPipeline,
     VDT_CmdBindDescriptorSets,
@@ -94,6 +96,7 @@ enum {
     VDT_CmdEndRenderPass,
     VDT_CmdSetViewport,
     VDT_CmdSetScissor,
+    VDT_CmdPushConstants,
     
     // Queue
     VDT_GetDeviceQueue,
@@ -175,6 +178,10 @@ static inline void vk_get_phys_dev_surf_fmts_khr(u32 *cnt, VkSurfaceFormatKHR *f
     vdt_call(GetPhysicalDeviceSurfaceFormatsKHR)(gpu->phys_dev, gpu->surf, cnt, fmts);
 }
 
+static inline void vk_get_phys_dev_surf_pres_modes_khr(u32 *cnt, VkPresentModeKHR *modes) {
+    vdt_call(GetPhysicalDeviceSurfacePresentModesKHR)(gpu->phys_dev, gpu->surf, cnt, modes);
+}
+
 static inline VkResult vk_create_sc_khr(VkSwapchainCreateInfoKHR *ci, VkSwapchainKHR *sc) {
     return cvk(vdt_call(CreateSwapchainKHR)(gpu->dev, ci, GAC, sc));
 }
@@ -414,6 +421,14 @@ static inline void vk_cmd_bufcpy(VkCommandBuffer cmd, u32 cnt, VkBufferCopy *reg
     vdt_call(CmdCopyBuffer)(cmd, from, to, cnt, regs);
 }
 
+static inline void vk_cmd_imgcpy(VkCommandBuffer cmd, u32 cnt, VkImageCopy *regs, VkImage from, VkImageLayout from_layout, VkImage to, VkImageLayout to_layout) {
+    vdt_call(CmdCopyImage)(cmd, from, from_layout, to, to_layout, cnt, regs);
+}
+
+static inline void vk_cmd_clear_att(VkCommandBuffer cmd, u32 att_cnt, VkClearAttachment *atts, u32 rect_cnt, VkClearRect *rects) {
+    vdt_call(CmdClearAttachments)(cmd, att_cnt, atts, rect_cnt, rects);
+}
+
 static inline void vk_cmd_begin_rp(VkCommandBuffer cmd, VkRenderPassBeginInfo *rbi, VkSubpassBeginInfo *sbi) {
     vdt_call(CmdBeginRenderPass2)(cmd, rbi, sbi);
 }
@@ -446,6 +461,10 @@ static inline void vk_cmd_set_scissor(VkCommandBuffer cmd, u32 first, u32 cnt, V
     vdt_call(CmdSetScissor)(cmd, first, cnt, s);
 }
 
+static inline void vk_cmd_push_const(VkCommandBuffer cmd, VkPipelineLayout pll, VkShaderStageFlags stages, u32 ofs, u32 sz, const void *p) {
+    vdt_call(CmdPushConstants)(cmd, pll, stages, ofs, sz, p);
+}
+
 static inline void vk_get_devq(u32 qi, VkQueue *qh) {
     vdt_call(GetDeviceQueue)(gpu->dev, qi, 0, qh);
 }
@@ -57,10 +57,17 @@ def_win_create_surf(win_create_surf)
 
 def_win_poll(win_poll)
 {
-    win->flags &= ~WIN_SZ;
+    // WIN_MIN holds until the window comes back, the caller just stops drawing
+    win->flags &= ~(WIN_MAX|WIN_RSZ|WIN_EXP);
     
     SDL_Event e;
-    while(SDL_PollEvent(&e) || (win->flags & WIN_MIN)) {
+    int ok;
+    if (wait_ms == 0)
+        ok = SDL_PollEvent(&e);
+    else
+        ok = SDL_WaitEventTimeout(&e, (int)(wait_ms < (Max_u32 >> 1) ? wait_ms : Max_u32 >> 1));
+    
+    for(; ok; ok = SDL_PollEvent(&e)) {
         switch(e.type) {
             
             case SDL_QUIT:
@@ -72,6 +79,7 @@ def_win_poll(win_poll)
                 struct keyboard_input ki;
                 ki.key = win_scancode_to_key(e.key.keysym.scancode);
                 ki.mod = e.type == SDL_KEYDOWN ? PRESS : RELEASE;
+                ki.tick = SDL_GetPerformanceCounter();
                 
                 if (e.key.keysym.mod & KMOD_CTRL) ki.mod |= CTRL;
                 if (e.key.keysym.mod & KMOD_ALT) ki.mod |= ALT;
@@ -96,16 +104,11 @@ def_win_poll(win_poll)
                     case SDL_WINDOWEVENT_MINIMIZED: {
                         win->flags &= ~WIN_SZ;
                         win->flags |= WIN_MIN;
-                        
-                        local_persist u32 pause_msg_timer = 0;
-                        if (pause_msg_timer == 0)
-                            pause_msg_timer = win_ms();
-                        
-                        if (pause_msg_timer < win_ms())
-                            pause_msg_timer += secs_to_ms(2);
-                        
                         println("Paused while minimized");
-                        os_sleep_ms(0);
+                    } break;
+                    
+                    case SDL_WINDOWEVENT_EXPOSED: {
+                        win->flags |= WIN_EXP;
                     } break;
                     
                     case SDL_WINDOWEVENT_MAXIMIZED: {
@@ -20,6 +20,7 @@ enum win_flags {
     WIN_MIN = 0x02,
     WIN_MAX = 0x04,
     WIN_RSZ = 0x08,
+    WIN_EXP = 0x10, // exposed, the contents need redrawing
     
     WIN_SZ = WIN_MIN|WIN_MAX|WIN_RSZ,
 };
@@ -27,6 +28,7 @@ enum win_flags {
 struct keyboard_input {
     u16 key; // enum key_codes
     u16 mod; // enum mod_flags
+    u64 tick; // SDL_GetPerformanceCounter when win_poll took it from SDL
 };
 
 #define KEY_BUFFER_SIZE 64
@@ -67,7 +69,8 @@ def_win_inst_exts(win_inst_exts);
 #define def_win_create_surf(name) int name(void)
 def_win_create_surf(win_create_surf);
 
-#define def_win_poll(name) int win_poll(void)
+// Handle pending events, first waiting up to wait_ms for one if there are none.
+#define def_win_poll(name) int name(u32 wait_ms)
 def_win_poll(win_poll);
 
 #define def_win_kb_next(name) bool name(struct keyboard_input *ki)